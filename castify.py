@@ -1,7 +1,7 @@
 #!/usr/bin/env python3
 # pip3 install pycryptodome
 
-import sys, os, struct
+import sys, os, struct, zlib
 import __future__
 
 from base64 import b16decode
@@ -17,6 +17,35 @@ loaderfile = sys.argv[1]
 elffile = sys.argv[2]
 outfile = sys.argv[3]
 hybrid_mbr_ancast = sys.argv[4].lower() == "true"
+compress_elf = len(sys.argv) > 5 and sys.argv[5].lower() == "true"
+
+# Deflates every PT_LOAD segment of a big-endian ELF32 on its own, so the
+# elfloader stub can inflate each one straight to its load address.
+def zelf_pack(elf):
+    if elf[:7] != b"\x7FELF\x01\x02\x01":
+        print("ERROR: %s is not a big-endian ELF32 file." % elffile)
+        sys.exit(1)
+
+    entry, phoff = struct.unpack(">II", elf[0x18:0x20])
+    phentsize, phnum = struct.unpack(">HH", elf[0x2A:0x2E])
+
+    segs = []
+    for i in range(phnum):
+        p_type, p_offset, p_vaddr, p_paddr, p_filesz, p_memsz, p_flags, p_align = \
+            struct.unpack(">8I", elf[phoff + i * phentsize:phoff + i * phentsize + 32])
+        if p_type != 1 or p_filesz == 0: # PT_LOAD
+            continue
+        segs.append((p_paddr, p_filesz, zlib.compress(elf[p_offset:p_offset + p_filesz], 9)))
+
+    table = b""
+    streams = b""
+    offset = 0x10 + 0x10 * len(segs)
+    for paddr, size, z in segs:
+        table += struct.pack(">IIII", paddr, size, offset + len(streams), len(z))
+        streams += z
+        print("Segment 0x%08X: 0x%X -> 0x%X bytes." % (paddr, size, len(z)))
+
+    return struct.pack(">4sIII", b"ZELF", entry, len(segs), 0) + table + streams
 
 print("Building payload...\n")
 
@@ -36,6 +65,8 @@ hdr = data[:hdrlen]
 loader = data[loaderoff:elfoff]
 
 elf = open(elffile,"rb").read()
+if compress_elf:
+    elf = zelf_pack(elf)
 
 if elflen > 0:
     print("WARNING: loader already contains ELF, will replace.")
@@ -25,6 +25,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 #include "hollywood.h"
 #include "string.h"
 #include "elf.h"
+#include "uzlib/tinf.h"
 
 typedef struct {
     u32 hdrsize;
@@ -33,6 +34,24 @@ typedef struct {
     u32 argument;
 } ioshdr;
 
+/* castify.py can replace the ELF with this: the PT_LOAD segments, each
+   deflated as its own zlib stream so it inflates straight to its address */
+#define ZELF_MAGIC 0x5A454C46 // ZELF
+
+typedef struct {
+    u32 magic;
+    u32 entry;
+    u32 count;
+    u32 reserved;
+} zelfhdr;
+
+typedef struct {
+    u32 dest;
+    u32 size;
+    u32 offset; // of the zlib stream, from the start of the ZELF header
+    u32 zsize;
+} zelfseg;
+
 void serial_send(u8 val);
 
 #define SERIAL_DELAY (1)
@@ -159,6 +178,42 @@ void *loadelf(const u8 *elf) {
     return ehdr->e_entry;
 }
 
+// too big for the stack
+static TINF_DATA inflate_state;
+
+void *loadzelf(const u8 *zelf)
+{
+    const zelfhdr *hdr = (const zelfhdr*)zelf;
+    const zelfseg *seg = (const zelfseg*)(hdr + 1);
+    TINF_DATA *d = &inflate_state;
+
+    uzlib_init();
+    for(u32 i = 0; i < hdr->count; i++, seg++)
+    {
+        u8 *dest = (u8*)seg->dest;
+
+        // no dictionary: back references are read from the output itself
+        uzlib_uncompress_init(d, NULL, 0);
+        d->source = zelf + seg->offset;
+        d->dest = dest;
+        if(uzlib_zlib_parse_header(d) < 0) {
+            panic(0xE5);
+        }
+
+        d->destSize = seg->size;
+        int res = uzlib_uncompress_chksum(d);
+        // the stream should end right after the last byte
+        if(res == TINF_OK) {
+            d->destSize = 1;
+            res = uzlib_uncompress_chksum(d);
+        }
+        if(res != TINF_DONE || d->dest != dest + seg->size) {
+            panic(0xE6);
+        }
+    }
+    return (void*)hdr->entry;
+}
+
 static inline void disable_boot0()
 {
     set32(HW_BOOT0, 0x1000);
@@ -191,10 +246,6 @@ void *_main(void *base)
     ioshdr *hdr = (ioshdr*)base;
     u8 *elf;
     void *entry;
-#if 0
-    u8 dict[0x1000];
-    TINF_DATA d;
-#endif
 
     // boot1 doesn't have an IOS header
     int is_boot1 = 0;
@@ -268,27 +319,6 @@ void *_main(void *base)
     elf = (u8*) base;
     elf += hdr->hdrsize + hdr->loadersize;
 
-#if 0
-    d.source = elf;
-    d.dest = (uint8_t*)TODO;
-    d.destSize = TODO;
-    uzlib_uncompress_init(&d, dict, sizeof(dict));
-    
-    res = uzlib_zlib_parse_header(&d); // returns dict_opt
-    if (res < 0) {
-        return res;
-    }
-    
-    do {
-        res = uzlib_uncompress(&d);
-        d.destSize = 1;
-    } while (res == TINF_OK);
-    
-    if(res != TINF_DONE) {
-        return res;
-    }
-#endif
-
     disable_boot0(1);
 
     if (is_boot1) {
@@ -299,7 +329,10 @@ void *_main(void *base)
         serial_send_u32(0xF00FCAFF);
     }
 
-    entry = loadelf(elf);
+    if (read32((u32)elf) == ZELF_MAGIC)
+        entry = loadzelf(elf);
+    else
+        entry = loadelf(elf);
     if (is_boot1)
         gpio_debug_send(0x8A);
     if (!is_boot1) {
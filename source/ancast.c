@@ -22,6 +22,7 @@
 #include <elf.h>
 #include <stddef.h>
 #include <dirent.h>
+#include <sys/stat.h>
 
 #include "sha.h"
 #include "crypto.h"
@@ -33,6 +34,7 @@
 #include "ff.h"
 
 #include "rednand.h"
+#include "trace.h"
 
 extern bool minute_on_slc;
 extern bool minute_on_sd;
@@ -50,10 +52,40 @@ typedef struct {
     void* body;
     u32 sector_idx;
     void* memory_load;
+    sha_ctx sha;
+    u32 hashed; // body bytes handed to the SHA engine so far
 } ancast_ctx;
 
+#define ANCAST_READ_CHUNK (0x100000)
+#define ANCAST_SECTOR_CHUNK (0x100) // raw sectors per sdcard_read
+
 int ancast_fini(ancast_ctx* ctx);
 
+#ifndef MINUTE_BOOT1
+/* Hashes the body that has landed in the first `loaded` bytes of the image. The
+   SHA engine works through it in the background while the next chunk is read. */
+static void _ancast_hash_loaded(ancast_ctx* ctx, u32 loaded)
+{
+    u32 total = ctx->header_size + ctx->header.body_size;
+    if(loaded > total)
+        loaded = total;
+    if(loaded <= ctx->header_size + ctx->hashed)
+        return;
+
+    u32 size = loaded - ctx->header_size - ctx->hashed;
+    // keep to whole blocks until the end so the engine can read in place
+    if(loaded != total)
+        size &= ~(SHA_BLOCK_SIZE - 1);
+    if(!size)
+        return;
+
+    sha_update_async(&ctx->sha, ctx->body + ctx->hashed, size);
+    ctx->hashed += size;
+}
+#else
+#define _ancast_hash_loaded(ctx, loaded) do {} while(0)
+#endif
+
 int ancast_init(ancast_ctx* ctx, const char* path)
 {
     if(!ctx || !path) return -1;
@@ -222,11 +254,16 @@ int ancast_load(ancast_ctx* ctx)
     }
 
     ctx->body = ctx->load + ctx->header_size;
+#ifndef MINUTE_BOOT1
+    sha_init(&ctx->sha);
+    ctx->hashed = 0;
+#endif
 
     if (ctx->memory_load)
     {
         u32 total_size = ctx->header_size + ctx->header.body_size;
         memcpy(ctx->load, ctx->memory_load, total_size);
+        _ancast_hash_loaded(ctx, total_size);
     }
 #if !defined(MINUTE_BOOT1) || defined(ISFSHAX_STAGE2)
     else if (ctx->file)
@@ -243,14 +280,14 @@ int ancast_load(ancast_ctx* ctx)
 
 #if 1
         int led_alternate = 0;
-        for (u32 i = 0; i < total_size; i += 0x100000)
+        for (u32 i = 0; i < total_size; i += ANCAST_READ_CHUNK)
         {
             if (i % 0x100000 == 0)
             {
                 printf("ancast: ...%08x -> %08x\n", i, (u32)ctx->load + i);
             }
 
-            u32 to_read = 0x100000;
+            u32 to_read = ANCAST_READ_CHUNK;
             if (i + to_read > total_size) {
                 to_read = total_size - i;
             }
@@ -258,9 +295,13 @@ int ancast_load(ancast_ctx* ctx)
             int count = fread(ctx->load + i, to_read, 1, ctx->file);
             if(count != 1) {
                 printf("ancast: failed to read offs=%08x, %s (%d).\n", i, ctx->path, errno);
+                sha_wait();
                 ancast_fini(ctx);
                 return errno;
             }
+
+            // hash this chunk while the next one is read
+            _ancast_hash_loaded(ctx, i + to_read);
         }
 #endif
 
@@ -279,42 +320,35 @@ int ancast_load(ancast_ctx* ctx)
 #endif
     else if (ctx->sector_idx)
     {
-        void* sdcard_dst = ctx->load;
-        u32 num_sectors = ctx->header_size + ctx->header.body_size;
-        num_sectors /= 0x200;
-        num_sectors += 1; // sloppy, but not the end of the world.
+        u32 total_size = ctx->header_size + ctx->header.body_size;
+        u32 num_sectors = (total_size + 0x1FF) / 0x200;
 
 #ifdef MINUTE_BOOT1
         serial_send_u32(num_sectors);
         serial_send_u32(ctx->header.body_size);
 #endif
 
-        memset(sdcard_dst, 0, ctx->header_size + ctx->header.body_size);
-
         int led_alternate = 0;
-        for (int i = 0; i < num_sectors; i++)
+        for (u32 i = 0; i < num_sectors; i += ANCAST_SECTOR_CHUNK)
         {
-            sdcard_dst = (void*)((u32)ctx->load + (i*0x200));
-            //serial_send_u32(i);
+            u32 count = min(num_sectors - i, ANCAST_SECTOR_CHUNK);
 
-#ifdef MINUTE_BOOT1
-            if (i % 0x10 == 0) {
-                serial_send_u32(i);
-                if (led_alternate) {
-                    smc_set_notification_led(LEDRAW_BLUE);
-                }
-                else {
-                    smc_set_notification_led(LEDRAW_PURPLE);
-                }
-                led_alternate = !led_alternate;
+            // straight to the load address, sdcard_read splits it as the host allows
+            int res = sdcard_read(ctx->sector_idx + i, count, ctx->load + i * 0x200);
+            if (res) {
+                printf("SD ancast: failed to read sector 0x%lx (%d).\n", ctx->sector_idx + i, res);
+                sha_wait();
+                ancast_fini(ctx);
+                return -4;
             }
+
+            // progress once per chunk, the LED goes through the SMC and is slow
+#ifdef MINUTE_BOOT1
+            serial_send_u32(i + count);
+            smc_set_notification_led(led_alternate ? LEDRAW_BLUE : LEDRAW_PURPLE);
+            led_alternate = !led_alternate;
 #endif
-            //serial_send_u32((u32)sdcard_dst);
-            sdcard_read(ctx->sector_idx + i, 1, sdcard_dst);
-            //serial_send_u32(*(u32*)sdcard_dst);
-            //sdcard_read(ctx->sector_idx + i, 1, sdcard_dst);
-            //serial_send_u32(*(u32*)sdcard_dst);
-            // TODO: why???
+            _ancast_hash_loaded(ctx, (i + count) * 0x200);
         }
 #ifdef MINUTE_BOOT1
         smc_set_notification_led(LEDRAW_PURPLE);
@@ -322,8 +356,10 @@ int ancast_load(ancast_ctx* ctx)
     }
 
 #ifndef MINUTE_BOOT1
+    // whatever is left, usually just the tail of the last chunk
+    _ancast_hash_loaded(ctx, ctx->header_size + ctx->header.body_size);
     u32 hash[SHA_HASH_WORDS] = {0};
-    sha_hash(ctx->body, hash, ctx->header.body_size);
+    sha_final(&ctx->sha, hash);
 
     u32* h1 = ctx->header.body_hash;
     u32* h2 = hash;
@@ -381,13 +417,14 @@ typedef struct {
     u32 ddr_init;
 } ios_header;
 
-u32 ancast_iop_load(const char* path)
+static u32 _ancast_iop_load(const char* path)
 {
     int res = 0;
     ancast_ctx ctx = {0};
 
     res = ancast_init(&ctx, path);
     if(res) return 0;
+    trace_counter("ios_size", ctx.header.body_size);
 
     u8 target = ctx.header.device >> 4;
     if(target != ANCAST_TARGET_IOP) {
@@ -424,6 +461,14 @@ u32 ancast_iop_load(const char* path)
     return vector;
 }
 
+u32 ancast_iop_load(const char* path)
+{
+    int t = trace_begin("ancast_load");
+    u32 vector = _ancast_iop_load(path);
+    trace_end(t);
+    return vector;
+}
+
 u32 ancast_ppc_load(const char* path)
 {
     int res = 0;
@@ -637,7 +682,22 @@ u32 ancast_patch_load(const char* fn_ios, const char* fn_patch, const char* plug
 
 #ifndef MINUTE_BOOT1
 
-char** ancast_plugins_list;
+typedef struct {
+    char name[ANCAST_PLUGIN_NAME_MAX];
+    u32 file_size;
+    u32 mtime; // 0 if the filesystem has none
+    u32 mem_size; // carveout bytes from the program headers, 0 if unusable
+} ancast_plugin_entry;
+
+// sizes of the plugins seen last time, so unchanged files don't need to be parsed again
+typedef struct {
+    u32 magic;
+    u32 count;
+    char path[ANCAST_PLUGIN_NAME_MAX];
+} ancast_plugin_manifest;
+
+// wafel_core first, then the other plugins sorted by name
+ancast_plugin_entry* ancast_plugins;
 int ancast_plugins_count;
 uintptr_t ancast_plugins_base = 0;
 uintptr_t ancast_plugin_last = 0;
@@ -645,7 +705,24 @@ uintptr_t ancast_plugin_next = 0;
 uintptr_t config_plugin_base = 0;
 
 int ancast_plugin_compare(const void* a, const void* b) {
-    return strcmp(*(const char**)a, *(const char**)b);
+    return strcmp(((const ancast_plugin_entry*)a)->name, ((const ancast_plugin_entry*)b)->name);
+}
+
+static int ancast_plugin_stat(const char* plugins_fpath, ancast_plugin_entry* plugin)
+{
+    char tmp[256];
+    struct stat st;
+    snprintf(tmp, sizeof(tmp)-1, "%s/%s", plugins_fpath, plugin->name);
+
+    plugin->file_size = 0;
+    plugin->mtime = 0;
+    plugin->mem_size = 0;
+    if(stat(tmp, &st))
+        return -1;
+
+    plugin->file_size = st.st_size;
+    plugin->mtime = st.st_mtime;
+    return 0;
 }
 
 u32 ancast_plugins_search(const char* plugins_fpath)
@@ -654,17 +731,16 @@ u32 ancast_plugins_search(const char* plugins_fpath)
     struct dirent* entry;
     const char* plugins_ext = ".ipx";
 
-    if (!ancast_plugins_list) {
-        ancast_plugins_list = malloc(MAX_PLUGINS * sizeof(char*));
-    }
-    else {
-        for (int i = 0; i < ancast_plugins_count; i++)
-        {
-            free(ancast_plugins_list[i]);
+    if (!ancast_plugins) {
+        ancast_plugins = malloc(MAX_PLUGINS * sizeof(*ancast_plugins));
+        if (!ancast_plugins) {
+            ancast_plugins_count = 0;
+            return 1;
         }
     }
-    memset(ancast_plugins_list, 0, MAX_PLUGINS * sizeof(char*));
-    ancast_plugins_count = 0;
+    memset(ancast_plugins, 0, MAX_PLUGINS * sizeof(*ancast_plugins));
+    strcpy(ancast_plugins[0].name, wafel_core_fn);
+    ancast_plugins_count = 1;
 
     // Open the directory
     dir = opendir(plugins_fpath);
@@ -680,8 +756,11 @@ u32 ancast_plugins_search(const char* plugins_fpath)
             && strcmp(entry->d_name, wafel_core_fn)
             && entry->d_name[0] != '.') 
         {
-            ancast_plugins_list[ancast_plugins_count] = malloc(strlen(entry->d_name) + 1);
-            strcpy(ancast_plugins_list[ancast_plugins_count], entry->d_name);
+            if (strlen(entry->d_name) >= ANCAST_PLUGIN_NAME_MAX) {
+                printf("ancast: plugin name `%s` is too long, skipping...\n", entry->d_name);
+                continue;
+            }
+            strcpy(ancast_plugins[ancast_plugins_count].name, entry->d_name);
             ancast_plugins_count++;
         }
     }
@@ -689,12 +768,16 @@ u32 ancast_plugins_search(const char* plugins_fpath)
     closedir(dir);
 
     // Sort the files array
-    qsort(ancast_plugins_list, ancast_plugins_count, sizeof(char*), ancast_plugin_compare);
+    qsort(ancast_plugins + 1, ancast_plugins_count - 1, sizeof(*ancast_plugins), ancast_plugin_compare);
 
-    // Print the sorted file names
+    // Stat the files and print the sorted names
     for (int i = 0; i < ancast_plugins_count; i++) {
-        printf("%s\n", ancast_plugins_list[i]);
+        ancast_plugin_stat(plugins_fpath, &ancast_plugins[i]);
+        if (i)
+            printf("%s\n", ancast_plugins[i].name);
     }
+
+    return 0;
 }
 
 void ancast_plugin_set_next(uintptr_t base, uintptr_t next)
@@ -787,11 +870,101 @@ u32 ancast_plugin_check_size(const char* fn_plugin, const char* plugins_fpath)
     return (u32)ALIGN_FORWARD(max_addr, 0x1000);
 }
 
-u32 ancast_plugin_load(uintptr_t base, const char* fn_plugin, const char* plugins_fpath)
+static int ancast_plugins_manifest_read(const char* plugins_fpath, ancast_plugin_entry* cached)
+{
+    ancast_plugin_manifest hdr;
+
+    FILE* f = fopen(ANCAST_PLUGIN_MANIFEST, "rb");
+    if(!f)
+        return 0;
+
+    int count = 0;
+    if(fread(&hdr, sizeof(hdr), 1, f) == 1 && hdr.magic == ANCAST_PLUGIN_MANIFEST_MAGIC
+       && hdr.count <= MAX_PLUGINS && !strncmp(hdr.path, plugins_fpath, sizeof(hdr.path))
+       && fread(cached, sizeof(*cached), hdr.count, f) == hdr.count)
+        count = hdr.count;
+    fclose(f);
+
+    return count;
+}
+
+static void ancast_plugins_manifest_write(const char* plugins_fpath)
+{
+    ancast_plugin_manifest hdr = {0};
+
+    // no point in caching what has to be looked at every time anyway
+    if(strlen(plugins_fpath) >= sizeof(hdr.path))
+        return;
+
+    FILE* f = fopen(ANCAST_PLUGIN_MANIFEST, "wb");
+    if(!f)
+        return;
+
+    hdr.magic = ANCAST_PLUGIN_MANIFEST_MAGIC;
+    hdr.count = ancast_plugins_count;
+    strcpy(hdr.path, plugins_fpath);
+    fwrite(&hdr, sizeof(hdr), 1, f);
+    fwrite(ancast_plugins, sizeof(*ancast_plugins), ancast_plugins_count, f);
+    fclose(f);
+}
+
+// Works out how much carveout every plugin needs, parsing only files the manifest doesn't know.
+static void ancast_plugins_plan(const char* plugins_fpath)
+{
+    ancast_plugin_entry* cached = malloc(MAX_PLUGINS * sizeof(*cached));
+    int cached_count = cached ? ancast_plugins_manifest_read(plugins_fpath, cached) : 0;
+    bool dirty = false;
+    int parsed = 0, cacheable = 0;
+
+    for (int i = 0; i < ancast_plugins_count; i++)
+    {
+        ancast_plugin_entry* plugin = &ancast_plugins[i];
+        if (!plugin->file_size)
+            continue;
+        if (plugin->mtime)
+            cacheable++;
+
+        for (int j = 0; j < cached_count; j++)
+        {
+            ancast_plugin_entry* old = &cached[j];
+            // without a modification time a same-sized replacement can't be told apart
+            if (plugin->mtime && old->mtime == plugin->mtime && old->file_size == plugin->file_size
+                && !strcmp(old->name, plugin->name)) {
+                plugin->mem_size = old->mem_size;
+                break;
+            }
+        }
+
+        if (!plugin->mem_size) {
+            plugin->mem_size = ancast_plugin_check_size(plugin->name, plugins_fpath);
+            // plugins without a modification time (SLC) are parsed every boot regardless
+            dirty |= plugin->mtime != 0;
+            parsed++;
+        }
+    }
+    free(cached);
+
+    // drop entries for plugins that are gone, but don't keep a manifest nothing can use
+    if (cacheable && cached_count != ancast_plugins_count)
+        dirty = true;
+
+    printf("ancast: %d plugins, %d parsed, %d from manifest\n", ancast_plugins_count, parsed,
+           ancast_plugins_count - parsed);
+    if (dirty)
+        ancast_plugins_manifest_write(plugins_fpath);
+}
+
+u32 ancast_plugin_load(uintptr_t base, const ancast_plugin_entry* plugin, const char* plugins_fpath)
 {
     char tmp[256];
     u8* plugin_base = (u8*)base; // TODO dynamic
-    snprintf(tmp, sizeof(tmp)-1, "%s/%s", plugins_fpath, fn_plugin);
+    snprintf(tmp, sizeof(tmp)-1, "%s/%s", plugins_fpath, plugin->name);
+
+    if(!plugin->mem_size)
+    {
+        printf("ancast: plugin `%s` is missing or invalid, skipping...\n", tmp);
+        return base;
+    }
 
     FILE* f_plugin = fopen(tmp, "rb");
     if(!f_plugin)
@@ -802,18 +975,27 @@ u32 ancast_plugin_load(uintptr_t base, const char* fn_plugin, const char* plugin
     else {
         printf("ancast: loading plugin `%s` to %08x\n", tmp, base);
     }
-    fread(plugin_base, CARVEOUT_SZ, 1, f_plugin);
+
+    // anything past the planned size would only be overwritten by the next plugin
+    u32 to_read = min(plugin->file_size, plugin->mem_size);
+    fread(plugin_base, to_read, 1, f_plugin);
     fclose(f_plugin);
+    memset(plugin_base + to_read, 0, plugin->mem_size - to_read);
+
     if(read32(base) != IPX_ELF_MAGIC) {
         printf("ancast: plugin `%s` has invalid magic %08x, skipping...\n", tmp, read32(base));
         return (u32)base;
     }
+    if(ancast_plugin_size(base) > plugin->mem_size) {
+        printf("ancast: plugin `%s` changed while loading, skipping...\n", tmp);
+        return (u32)base;
+    }
 
     // Update last plugin's plugin_next
     ancast_plugin_set_next(ancast_plugin_last, base);
 
     ancast_plugin_last = base;
-    return (u32)base + ancast_plugin_size(base);
+    return (u32)base + plugin->mem_size;
 }
 
 // Copy DATA segment into carveout from memory
@@ -896,15 +1078,18 @@ static u32 ancast_get_abi_version(uintptr_t base){
     return *(u32*)(base + ehdr->e_entry + 0x1C);
 }
 
-int ancast_plugins_load(const char* plugins_fpath, bool rednand)
+static int _ancast_plugins_load(const char* plugins_fpath, bool rednand)
 {
     u32 tmp = 0;
-    ancast_plugins_search(plugins_fpath);
+    if (ancast_plugins_search(plugins_fpath) && !ancast_plugins)
+        return -1;
+    trace_counter("plugins", ancast_plugins_count);
+    ancast_plugins_plan(plugins_fpath);
 
-    u32 total_size = ancast_plugin_check_size(wafel_core_fn, plugins_fpath) + 0x1000;
+    u32 total_size = 0x1000;
     for (int i = 0; i < ancast_plugins_count; i++)
     {
-        total_size += ancast_plugin_check_size(ancast_plugins_list[i], plugins_fpath);
+        total_size += ancast_plugins[i].mem_size;
     }
     total_size += 0x10000; // TODO remove data padding/do it right?
 
@@ -915,10 +1100,9 @@ int ancast_plugins_load(const char* plugins_fpath, bool rednand)
     ancast_plugin_next = ancast_plugins_base;
     ancast_plugin_last = 0;
 
-    ancast_plugin_next = ancast_plugin_load(ancast_plugin_next, wafel_core_fn, plugins_fpath);
     for (int i = 0; i < ancast_plugins_count; i++)
     {
-        ancast_plugin_next = ancast_plugin_load(ancast_plugin_next, ancast_plugins_list[i], plugins_fpath);
+        ancast_plugin_next = ancast_plugin_load(ancast_plugin_next, &ancast_plugins[i], plugins_fpath);
     }
 
     u32 abi_version = ancast_get_abi_version(ancast_plugins_base);
@@ -958,4 +1142,20 @@ int ancast_plugins_load(const char* plugins_fpath, bool rednand)
 
     return 0;
 }
+
+int ancast_plugins_load(const char* plugins_fpath, bool rednand)
+{
+    int t = trace_begin("plugins_load");
+    int res = _ancast_plugins_load(plugins_fpath, rednand);
+    trace_end(t);
+    if(res < 0)
+        return res;
+
+    // the carveout survives into IOS, keep tracing there so the next boot can pick it up
+    uintptr_t trace_base = ancast_plugin_next;
+    ancast_plugin_next = ancast_plugin_data_copy(trace_base, (const u8*)trace_get(), sizeof(trace_buf));
+    trace_persist((trace_buf*)(trace_base + IPX_DATA_START));
+
+    return 0;
+}
 #endif
\ No newline at end of file
@@ -57,6 +57,9 @@ extern uintptr_t ancast_plugins_base;
 #define CARVEOUT_SZ (0x400000)
 #define MAGIC_PLUG (0x504C5547)
 #define MAX_PLUGINS (256)
+#define ANCAST_PLUGIN_NAME_MAX (64)
+#define ANCAST_PLUGIN_MANIFEST "sdmc:/minute/plugins.manifest"
+#define ANCAST_PLUGIN_MANIFEST_MAGIC (0x504D414E) // PMAN
 
 #define RAMDISK_END_ADDR (0x28000000)
 #define MAGIC_PLUG_ADDR (RAMDISK_END_ADDR-8)
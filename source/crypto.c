@@ -26,6 +26,7 @@
 #define     AES_CMD_DECRYPT 0x9800
 #define     AES_CMD_ENCRYPT 0x9000
 #define     AES_CMD_COPY    0x8000
+#define     AES_CMD_FLAG_IRQ 0x4000
 
 otp_t otp;
 seeprom_t seeprom;
@@ -123,6 +124,7 @@ void crypto_initialize(void)
 
     aes_reset();
     irq_enable(IRQ_AES);
+    irq_enable(IRQ_SHA1);
 
     memcpy(&seeprom_decrypted, &seeprom, sizeof(seeprom));
 }
@@ -161,29 +163,26 @@ int crypto_verify_seeprom_ptr(seeprom_t* pSeeprom)
     return 1;
 }
 
+static const u8 seeprom_iv[0x10] = {0};
+
 int crypto_decrypt_verify_seeprom_ptr(seeprom_t* pOut, seeprom_t* pSeeprom)
 {
-    static u8 seeprom_tmp[0x10] ALIGNED(16);
+    static u8 seeprom_tmp[3][0x10] ALIGNED(32);
 
     memcpy(pOut, pSeeprom, sizeof(*pSeeprom));
     aes_reset();
     aes_set_key(otp.seeprom_key);
 
-    // Decrypt the three SEEPROM blocks
-    aes_empty_iv();
-    memcpy(seeprom_tmp, &pOut->hw_params, 0x10);
-    aes_decrypt(seeprom_tmp, seeprom_tmp, 1, 0);
-    memcpy(&pOut->hw_params, seeprom_tmp, 0x10);
-
-    aes_empty_iv();
-    memcpy(seeprom_tmp, &pOut->boot1_params, 0x10);
-    aes_decrypt(seeprom_tmp, seeprom_tmp, 1, 0);
-    memcpy(&pOut->boot1_params, seeprom_tmp, 0x10);
-
-    aes_empty_iv();
-    memcpy(seeprom_tmp, &pOut->boot1_copy_params, 0x10);
-    aes_decrypt(seeprom_tmp, seeprom_tmp, 1, 0);
-    memcpy(&pOut->boot1_copy_params, seeprom_tmp, 0x10);
+    // Decrypt the three SEEPROM blocks, each one with a fresh IV
+    memcpy(seeprom_tmp[0], &pOut->hw_params, 0x10);
+    memcpy(seeprom_tmp[1], &pOut->boot1_params, 0x10);
+    memcpy(seeprom_tmp[2], &pOut->boot1_copy_params, 0x10);
+    for (int i = 0; i < 3; i++)
+        aes_decrypt_async(seeprom_tmp[i], seeprom_tmp[i], 1, 0, seeprom_iv);
+    aes_wait();
+    memcpy(&pOut->hw_params, seeprom_tmp[0], 0x10);
+    memcpy(&pOut->boot1_params, seeprom_tmp[1], 0x10);
+    memcpy(&pOut->boot1_copy_params, seeprom_tmp[2], 0x10);
 
     u32 crc_1 = crc32(&pOut->hw_params, 0xC);
     u32 crc_2 = crc32(&pOut->boot1_params, 0xC);
@@ -206,7 +205,7 @@ int crypto_decrypt_verify_seeprom_ptr(seeprom_t* pOut, seeprom_t* pSeeprom)
 int crypto_encrypt_verify_seeprom_ptr(seeprom_t* pOut, seeprom_t* pSeeprom)
 {
     seeprom_t extra_verify;
-    static u8 seeprom_tmp[0x10] ALIGNED(16);
+    static u8 seeprom_tmp[3][0x10] ALIGNED(32);
 
     memcpy(pOut, pSeeprom, sizeof(*pSeeprom));
 
@@ -229,21 +228,16 @@ int crypto_encrypt_verify_seeprom_ptr(seeprom_t* pOut, seeprom_t* pSeeprom)
     aes_reset();
     aes_set_key(otp.seeprom_key);
 
-    // Decrypt the three SEEPROM blocks
-    aes_empty_iv();
-    memcpy(seeprom_tmp, &pOut->hw_params, 0x10);
-    aes_encrypt(seeprom_tmp, seeprom_tmp, 1, 0);
-    memcpy(&pOut->hw_params, seeprom_tmp, 0x10);
-
-    aes_empty_iv();
-    memcpy(seeprom_tmp, &pOut->boot1_params, 0x10);
-    aes_encrypt(seeprom_tmp, seeprom_tmp, 1, 0);
-    memcpy(&pOut->boot1_params, seeprom_tmp, 0x10);
-
-    aes_empty_iv();
-    memcpy(seeprom_tmp, &pOut->boot1_copy_params, 0x10);
-    aes_encrypt(seeprom_tmp, seeprom_tmp, 1, 0);
-    memcpy(&pOut->boot1_copy_params, seeprom_tmp, 0x10);
+    // Encrypt the three SEEPROM blocks, each one with a fresh IV
+    memcpy(seeprom_tmp[0], &pOut->hw_params, 0x10);
+    memcpy(seeprom_tmp[1], &pOut->boot1_params, 0x10);
+    memcpy(seeprom_tmp[2], &pOut->boot1_copy_params, 0x10);
+    for (int i = 0; i < 3; i++)
+        aes_encrypt_async(seeprom_tmp[i], seeprom_tmp[i], 1, 0, seeprom_iv);
+    aes_wait();
+    memcpy(&pOut->hw_params, seeprom_tmp[0], 0x10);
+    memcpy(&pOut->boot1_params, seeprom_tmp[1], 0x10);
+    memcpy(&pOut->boot1_copy_params, seeprom_tmp[2], 0x10);
 
     // Juuust in case
     return crypto_decrypt_verify_seeprom_ptr(&extra_verify, pOut);
@@ -251,9 +245,140 @@ int crypto_encrypt_verify_seeprom_ptr(seeprom_t* pOut, seeprom_t* pSeeprom)
 
 static int _aes_irq = 0;
 
+// queued jobs, fed to the engine 0x80 blocks at a time from aes_irq() or aes_poll()
+#define AES_QUEUE_LEN 16
+
+typedef struct {
+    u8 *src;
+    u8 *dst;
+    u32 blocks;
+    u16 cmd;
+    u8 keep_iv;
+    bool started;
+    bool load_iv;
+    u32 iv[4];
+} aes_desc;
+
+static struct {
+    aes_desc desc[AES_QUEUE_LEN];
+    u32 submitted;
+    u32 completed;
+} aes_queue;
+
+static void _aes_queue_advance(void)
+{
+    while (aes_queue.completed != aes_queue.submitted) {
+        if (read32(AES_CTRL) & 0x80000000)
+            return;
+
+        aes_desc *d = &aes_queue.desc[aes_queue.completed % AES_QUEUE_LEN];
+        if (d->started && !d->blocks) {
+            ahb_flush_from(WB_AES);
+            ahb_flush_to(RB_IOD);
+            aes_queue.completed++;
+            continue;
+        }
+
+        if (!d->started) {
+            if (d->load_iv) {
+                for (int i = 0; i < 4; i++)
+                    write32(AES_IV, d->iv[i]);
+            }
+            d->started = true;
+        }
+
+        u32 this_blocks = d->blocks;
+        if (this_blocks > 0x80)
+            this_blocks = 0x80;
+
+        write32(AES_SRC, dma_addr(d->src));
+        write32(AES_DEST, dma_addr(d->dst));
+        _aes_irq = 0;
+        write32(AES_CTRL, ((d->cmd | AES_CMD_FLAG_IRQ) << 16) |
+                          (d->keep_iv ? 0x1000 : 0) | ((this_blocks - 1) & 0x7f));
+
+        d->blocks -= this_blocks;
+        d->src += this_blocks << 4;
+        d->dst += this_blocks << 4;
+        d->keep_iv = 1;
+        return;
+    }
+}
+
 void aes_irq(void)
 {
     _aes_irq = 1;
+    _aes_queue_advance();
+}
+
+bool aes_done(u32 ticket)
+{
+    u32 cookie = irq_kill();
+    _aes_queue_advance();
+    bool done = (s32)(aes_queue.completed - ticket) >= 0;
+    irq_restore(cookie);
+    return done;
+}
+
+bool aes_poll(void)
+{
+    return aes_done(aes_queue.submitted);
+}
+
+void aes_wait_ticket(u32 ticket)
+{
+    while (!aes_done(ticket));
+}
+
+void aes_wait(void)
+{
+    aes_wait_ticket(aes_queue.submitted);
+}
+
+static u32 aes_submit(u16 cmd, u8 *src, u8 *dst, u32 blocks, u8 keep_iv, const u8 *iv)
+{
+    if (!blocks)
+        return aes_queue.submitted;
+
+    // Kinda have to do both flush/invalidate on both because if you crypt
+    // 1 block, an invalidate will corrupt the periphery memory in the cache
+    // line.
+    dc_flushrange(src, blocks * 16);
+    dc_invalidaterange(src, blocks * 16);
+    dc_flushrange(dst, blocks * 16);
+    dc_invalidaterange(dst, blocks * 16);
+    ahb_flush_to(RB_AES);
+
+    // wait for a free descriptor
+    while (aes_queue.submitted - aes_queue.completed >= AES_QUEUE_LEN)
+        aes_poll();
+
+    u32 cookie = irq_kill();
+    aes_desc *d = &aes_queue.desc[aes_queue.submitted % AES_QUEUE_LEN];
+    d->src = src;
+    d->dst = dst;
+    d->blocks = blocks;
+    d->cmd = cmd;
+    d->keep_iv = keep_iv;
+    d->started = false;
+    d->load_iv = iv != NULL;
+    if (iv)
+        memcpy(d->iv, iv, sizeof(d->iv));
+    u32 ticket = ++aes_queue.submitted;
+    _aes_queue_advance();
+    irq_restore(cookie);
+
+    return ticket;
+}
+
+u32 aes_decrypt_async(u8 *src, u8 *dst, u32 blocks, u8 keep_iv, const u8 *iv)
+{
+    return aes_submit(AES_CMD_DECRYPT, src, dst, blocks, keep_iv, iv);
+}
+
+u32 aes_encrypt_async(u8 *src, u8 *dst, u32 blocks, u8 keep_iv, const u8 *iv)
+{
+    return aes_submit(AES_CMD_ENCRYPT, src, dst, blocks, keep_iv, iv);
 }
 
 static inline void aes_command(u16 cmd, u8 iv_keep, u32 blocks)
@@ -267,12 +392,14 @@ static inline void aes_command(u16 cmd, u8 iv_keep, u32 blocks)
 
 void aes_reset(void)
 {
+    aes_wait();
     write32(AES_CTRL, 0);
     while (read32(AES_CTRL) != 0);
 }
 
 void aes_set_iv(u8 *iv)
 {
+    aes_wait();
     u32 iv_tmp[4];
     memcpy(iv_tmp, iv, 4*sizeof(u32));
 
@@ -283,6 +410,7 @@ void aes_set_iv(u8 *iv)
 
 void aes_empty_iv(void)
 {
+    aes_wait();
     for(int i = 0; i < 4; i++) {
         write32(AES_IV, 0);
     }
@@ -290,6 +418,7 @@ void aes_empty_iv(void)
 
 void aes_set_key(u8 *key)
 {
+    aes_wait();
     u32 key_tmp[4];
     memcpy(key_tmp, key, 4*sizeof(u32));
 
@@ -300,74 +429,18 @@ void aes_set_key(u8 *key)
 
 void aes_decrypt(u8 *src, u8 *dst, u32 blocks, u8 keep_iv)
 {
-    // Kinda have to do both flush/invalidate on both because if you crypt
-    // 1 block, an invalidate will corrupt the periphery memory in the cache
-    // line.
-    dc_flushrange(src, blocks * 16);
-    dc_invalidaterange(src, blocks * 16);
-    dc_flushrange(dst, blocks * 16);
-    dc_invalidaterange(dst, blocks * 16);
-    ahb_flush_to(RB_AES);
-
-    int this_blocks = 0;
-    while(blocks > 0) {
-        this_blocks = blocks;
-        if (this_blocks > 0x80)
-            this_blocks = 0x80;
-
-        write32(AES_SRC, dma_addr(src));
-        write32(AES_DEST, dma_addr(dst));
-
-        aes_command(AES_CMD_DECRYPT, keep_iv, this_blocks);
-
-        blocks -= this_blocks;
-        src += this_blocks<<4;
-        dst += this_blocks<<4;
-        keep_iv = 1;
-    }
-
-    ahb_flush_from(WB_AES);
-    ahb_flush_to(RB_IOD);
-    //dc_flushrange(dst, blocks * 16);
-    //dc_invalidaterange(dst, blocks * 16);
+    aes_wait_ticket(aes_submit(AES_CMD_DECRYPT, src, dst, blocks, keep_iv, NULL));
 }
 
 void aes_encrypt(u8 *src, u8 *dst, u32 blocks, u8 keep_iv)
 {
-    // Kinda have to do both flush/invalidate on both because if you crypt
-    // 1 block, an invalidate will corrupt the periphery memory in the cache
-    // line.
-    dc_flushrange(src, blocks * 16);
-    dc_invalidaterange(src, blocks * 16);
-    dc_flushrange(dst, blocks * 16);
-    dc_invalidaterange(dst, blocks * 16);
-    ahb_flush_to(RB_AES);
-
-    int this_blocks = 0;
-    while(blocks > 0) {
-        this_blocks = blocks;
-        if (this_blocks > 0x80)
-            this_blocks = 0x80;
-
-        write32(AES_SRC, dma_addr(src));
-        write32(AES_DEST, dma_addr(dst));
-
-        aes_command(AES_CMD_ENCRYPT, keep_iv, this_blocks);
-
-        blocks -= this_blocks;
-        src += this_blocks<<4;
-        dst += this_blocks<<4;
-        keep_iv = 1;
-    }
-
-    ahb_flush_from(WB_AES);
-    ahb_flush_to(RB_IOD);
-    //dc_flushrange(dst, blocks * 16);
-    //dc_invalidaterange(dst, blocks * 16);
+    aes_wait_ticket(aes_submit(AES_CMD_ENCRYPT, src, dst, blocks, keep_iv, NULL));
 }
 
 void aes_copy(u8 *src, u8 *dst, u32 blocks)
 {
+    aes_wait();
+
     // Kinda have to do both flush/invalidate on both because if you crypt
     // 1 block, an invalidate will corrupt the periphery memory in the cache
     // line.
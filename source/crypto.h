@@ -267,5 +267,15 @@ void aes_decrypt(u8 *src, u8 *dst, u32 blocks, u8 keep_iv);
 void aes_encrypt(u8 *src, u8 *dst, u32 blocks, u8 keep_iv);
 void aes_copy(u8 *src, u8 *dst, u32 blocks);
 
+/* queued jobs run in submission order, each returns a ticket for aes_done()/aes_wait_ticket().
+ * a non-NULL iv is loaded right before the job starts, the key must stay put until aes_wait(). */
+void aes_irq(void);
+u32 aes_decrypt_async(u8 *src, u8 *dst, u32 blocks, u8 keep_iv, const u8 *iv);
+u32 aes_encrypt_async(u8 *src, u8 *dst, u32 blocks, u8 keep_iv, const u8 *iv);
+bool aes_done(u32 ticket);
+void aes_wait_ticket(u32 ticket);
+bool aes_poll(void);
+void aes_wait(void);
+
 #endif
 
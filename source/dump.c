@@ -38,6 +38,7 @@
 
 #include "smc.h"
 #include "crypto.h"
+#include "log.h"
 
 #ifndef MINUTE_BOOT1
 #ifndef FASTBOOT
@@ -45,6 +46,9 @@
 // TODO: how many sectors is 8gb MLC WFS?
 #define TOTAL_SECTORS (0x3A20000)
 
+// failed SD transfers of the same blocks before a dump or restore gives up
+#define DUMP_SD_RETRIES (5)
+
 extern seeprom_t seeprom;
 extern otp_t otp;
 
@@ -76,6 +80,8 @@ menu menu_dump = {
             {"Dump OTP via PRSHhax", &dump_otp_via_prshhax},
             {"Dump SLC.RAW", &dump_slc_raw},
             {"Dump SLCCMPT.RAW", &dump_slccmpt_raw},
+            {"Dump SLC.RAW (sparse)", &dump_slc_raw_sparse},
+            {"Dump SLCCMPT.RAW (sparse)", &dump_slccmpt_raw_sparse},
             {"Dump BOOT1_SLC.RAW", &dump_boot1_raw},
             {"Dump BOOT1_SLCCMPT.RAW", &dump_boot1_vwii_raw},
             {"Dump factory log", &dump_factory_log},
@@ -100,7 +106,7 @@ menu menu_dump = {
             {"Print SLC superblocks", &dump_print_slc_superblocks},
             {"Return to Main Menu", &menu_close},
     },
-    28, // number of options
+    30, // number of options
     0,
     0
 };
@@ -770,88 +776,461 @@ ret:
     console_power_or_eject_to_return();
 }
 
-int _dump_mlc(u32 base)
+// Ring buffer copy between two sdmmc hosts. Each host has at most one command in flight,
+// but the reader may run up to DUMP_RING_SLOTS buffers ahead of the writer, so a stall on
+// one side (SD card garbage collection, eMMC housekeeping) doesn't stop the other.
+#define DUMP_RING_SLOTS         4
+#define DUMP_RING_SLOT_SECTORS  0x800 // 1MiB, one command each with ADMA
+#define DUMP_RING_MEASURE_SLOTS 8 // full slots timed before a transfer size is compared with the last one
+#define DUMP_RING_RETRIES       16 // failures in a row on one side before the copy gives up
+#define DUMP_RING_TIMEOUT       (2 * 1900000) // LT_TIMER ticks before falling back to a blocking wait
+
+typedef struct {
+    const char* name;
+    int (*start)(u32 blk_start, u32 blk_count, void *data, struct sdmmc_command* cmdbuf);
+    int (*end)(struct sdmmc_command* cmdbuf);
+    int (*done)(struct sdmmc_command* cmdbuf);
+    u32 (*max_blocks)(void);
+    u32 base;
+    int (*erase)(u32 start, u32 end); // optional, inclusive range
+    u32 (*erase_sectors)(void); // erase group size, 0 if unknown
+} dump_copy_dev;
+
+typedef struct {
+    const dump_copy_dev* dev;
+    struct sdmmc_command cmd;
+    bool busy;
+    int start_res;
+    u32 issued;
+    u32 slot;   // slot being transferred, counted from the start of the copy
+    u32 offset; // sectors of that slot already done
+    u32 count;  // sectors in flight
+    u32 chunk;  // transfer size, halved on errors, otherwise set by the time per slot
+    u32 max;    // largest transfer the host takes in one command
+    u32 busy_ticks; // LT_TIMER ticks spent on transfers of the current slot
+    bool slot_error;
+    u32 timed;  // full slots timed at this transfer size
+    u32 total;  // and the ticks they took
+    u32 prev_chunk, prev_avg; // size being compared against and its mean ticks per slot
+    bool settled;
+    u32 errors;
+    u32 retries; // failures since the last transfer that worked
+    int failed;  // error the side gave up on
+} dump_copy_side;
+
+typedef struct {
+    const char* name;
+    const dump_copy_dev* dst;
+    const dump_copy_dev* verify;
+    u32 total_sectors;
+    u32 total_slots;
+    u32 last_tick;
+    u64 ticks;
+    u32 written, skipped, erased;
+    // pending run of all-zero slots, erased in one go once it ends
+    u32 zero_start, zero_count;
+    bool zero_dirty;
+    bool erase_ok;
+    u32 erase_group; // sectors, erases cover whole groups
+    u8* scratch;
+    u8* zeros;
+} dump_copy_ctx;
+
+static u32 _dump_copy_slot_sectors(u32 slot, u32 total_sectors)
 {
-    sdcard_ack_card();
-    if(sdcard_check_card() != SDMMC_INSERTED) {
-        printf("SD card is not initialized.\n");
-        return -1;
+    return min(total_sectors - slot * DUMP_RING_SLOT_SECTORS, DUMP_RING_SLOT_SECTORS);
+}
+
+static void _dump_copy_issue(dump_copy_side* side, u8* buf, u32 total_sectors)
+{
+    u32 sector = side->slot * DUMP_RING_SLOT_SECTORS + side->offset;
+
+    side->count = min(_dump_copy_slot_sectors(side->slot, total_sectors) - side->offset, side->chunk);
+    side->start_res = side->dev->start(side->dev->base + sector, side->count,
+                                       buf + side->offset * SDMMC_DEFAULT_BLOCKLEN, &side->cmd);
+    side->issued = read32(LT_TIMER);
+    side->busy = true;
+}
+
+static bool _dump_copy_ready(dump_copy_side* side)
+{
+    return side->start_res || side->dev->done(&side->cmd) ||
+           (read32(LT_TIMER) - side->issued) > DUMP_RING_TIMEOUT;
+}
+
+static void _dump_copy_set_chunk(dump_copy_side* side, u32 chunk)
+{
+    side->chunk = chunk;
+    side->timed = 0;
+    side->total = 0;
+}
+
+/*
+ * Picks the transfer size from how long full slots take. Every
+ * DUMP_RING_MEASURE_SLOTS slots the mean is taken and the size is doubled (or,
+ * already at the host maximum, halved once) and kept only if slots get through
+ * faster; a bigger size may be up to 1/8 slower since it also means fewer commands.
+ */
+static void _dump_copy_tune(dump_copy_side* side)
+{
+    if(side->slot_error)
+        return;
+
+    side->total += side->busy_ticks;
+    if(++side->timed < DUMP_RING_MEASURE_SLOTS)
+        return;
+
+    u32 avg = side->total / side->timed;
+    if(side->prev_chunk) {
+        u32 prev_chunk = side->prev_chunk, prev_avg = side->prev_avg;
+        bool keep = side->chunk > prev_chunk ? avg <= prev_avg + prev_avg / 8
+                                             : avg + prev_avg / 8 < prev_avg;
+
+        side->prev_chunk = 0;
+        if(!keep) {
+            _dump_copy_set_chunk(side, prev_chunk);
+            side->settled = true;
+            return;
+        }
+        // smaller ones were already known to be slower
+        if(side->chunk < prev_chunk || side->chunk >= side->max)
+            side->settled = true;
+    }
+    if(side->settled)
+        return;
+
+    side->prev_chunk = side->chunk;
+    side->prev_avg = avg;
+    if(side->chunk < side->max)
+        _dump_copy_set_chunk(side, side->chunk << 1);
+    else if(side->chunk > 1)
+        _dump_copy_set_chunk(side, side->chunk >> 1);
+    else
+        side->prev_chunk = 0;
+}
+
+// returns true once the whole slot has been transferred
+static bool _dump_copy_complete(dump_copy_side* side, u32 total_sectors)
+{
+    int res = side->start_res;
+    if(!res)
+        res = side->dev->end(&side->cmd);
+    side->busy = false;
+    side->busy_ticks += read32(LT_TIMER) - side->issued;
+
+    if(res) {
+        side->errors++;
+        side->slot_error = true;
+        if(++side->retries >= DUMP_RING_RETRIES) {
+            printf("%s: error %d at sector 0x%08lX, giving up after %lu tries\n", side->dev->name, res,
+                   side->dev->base + side->slot * DUMP_RING_SLOT_SECTORS + side->offset, side->retries);
+            side->failed = res;
+            return false;
+        }
+        // start measuring from scratch once the smaller size gets through
+        side->prev_chunk = 0;
+        side->settled = false;
+        u32 max = min(side->dev->max_blocks(), DUMP_RING_SLOT_SECTORS);
+        if(max < side->max) {
+            // the host gave up on ADMA2, retry the same transfer in pieces SDMA takes
+            side->max = max;
+            _dump_copy_set_chunk(side, min(side->chunk, max));
+        } else if(side->chunk > 1) {
+            _dump_copy_set_chunk(side, side->chunk >> 1);
+            printf("%s: error %d at sector 0x%08lX, retrying %lu sectors at a time\n", side->dev->name, res,
+                   side->dev->base + side->slot * DUMP_RING_SLOT_SECTORS + side->offset, side->chunk);
+        }
+        return false;
+    }
+
+    side->retries = 0;
+    side->offset += side->count;
+    if(side->offset < _dump_copy_slot_sectors(side->slot, total_sectors))
+        return false;
+
+    // only full slots are comparable
+    if(_dump_copy_slot_sectors(side->slot, total_sectors) == DUMP_RING_SLOT_SECTORS)
+        _dump_copy_tune(side);
+    side->busy_ticks = 0;
+    side->slot_error = false;
+    side->offset = 0;
+    side->slot++;
+    return true;
+}
+
+// blocking transfer on an idle host, used for the odd read-back and zero fill
+static int _dump_copy_sync(const dump_copy_dev* dev, u32 sector, u32 count, u8* buf)
+{
+    struct sdmmc_command cmd;
+    u32 max = min(dev->max_blocks(), DUMP_RING_SLOT_SECTORS);
+    int res = 0;
+
+    for(u32 done = 0; done < count && !res; done += max) {
+        u32 part = min(count - done, max);
+        for(int tries = 0; tries < 5; tries++) {
+            res = dev->start(dev->base + sector + done, part, buf + done * SDMMC_DEFAULT_BLOCKLEN, &cmd);
+            if(!res)
+                res = dev->end(&cmd);
+            if(!res)
+                break;
+        }
     }
+    return res;
+}
 
-    if(mlc_init())
-        return -1;
+static bool _dump_copy_is_zero(const u8* buf, u32 len)
+{
+    const u32* words = (const u32*)buf;
+    for(u32 i = 0; i < len / sizeof(u32); i++)
+        if(words[i]) return false;
+    return true;
+}
 
-    int res = 0, mres = 0, sres = 0;
-    if(base == 0) return -2;
+static int _dump_copy_fill_zero(dump_copy_ctx* ctx, u32 start, u32 end)
+{
+    for(u32 sector = start; sector < end; sector += DUMP_RING_SLOT_SECTORS) {
+        u32 count = min(end - sector, DUMP_RING_SLOT_SECTORS);
+        int res = _dump_copy_sync(ctx->dst, sector, count, ctx->zeros);
+        if(res) {
+            printf("%s: failed to write sector 0x%08lX (%d)\n", ctx->name, ctx->dst->base + sector, res);
+            return res;
+        }
+        ctx->written += count;
+    }
+    return 0;
+}
 
-    // This uses "async" read/write functions, combined with double buffering to achieve a
-    // much faster dump. This works because these are two separate host controllers using DMA.
-    // Instead of running a single command and waiting for completion, we queue both commands
-    // and then wait for them both to complete at the end of each iteration.
-    struct sdmmc_command mlc_cmd = {0}, sdcard_cmd = {0};
+// erases the aligned middle of the pending zero run and writes zeros to its ragged edges
+static int _dump_copy_flush_zero(dump_copy_ctx* ctx)
+{
+    u32 start = ctx->zero_start, end = ctx->zero_start + ctx->zero_count;
+    int res = 0;
+
+    if(!ctx->zero_count)
+        return 0;
+    ctx->zero_count = 0;
+
+    if(!ctx->zero_dirty) {
+        ctx->skipped += end - start;
+        return 0;
+    }
+
+    if(!ctx->erase_ok)
+        return _dump_copy_fill_zero(ctx, start, end);
+
+    // groups are aligned on the device, not within the copy
+    u32 base = ctx->dst->base, group = ctx->erase_group;
+    u32 erase_start = (base + start + group - 1) / group * group - base;
+    u32 erase_end = (base + end) / group * group - base;
+    if(erase_start >= erase_end)
+        return _dump_copy_fill_zero(ctx, start, end);
+
+    u32 check = min(erase_end - erase_start, DUMP_RING_SLOT_SECTORS);
+    res = ctx->dst->erase(base + erase_start, base + erase_end - 1);
+    if(res) {
+        printf("%s: erase of sectors 0x%08lX-0x%08lX failed (%d), writing them instead\n", ctx->name,
+               base + erase_start, base + erase_end - 1, res);
+        ctx->erase_ok = false;
+        erase_start = erase_end = end;
+    } else if(!_dump_copy_sync(ctx->verify, erase_start, check, ctx->scratch) &&
+              _dump_copy_is_zero(ctx->scratch, check * SDMMC_DEFAULT_BLOCKLEN)) {
+        ctx->erased += erase_end - erase_start;
+    } else {
+        printf("%s: erased sectors don't read back as zero, writing them instead\n", ctx->name);
+        ctx->erase_ok = false;
+        erase_start = erase_end = end;
+    }
+
+    res = _dump_copy_fill_zero(ctx, start, erase_start);
+    if(!res)
+        res = _dump_copy_fill_zero(ctx, erase_end, end);
+    return res;
+}
+
+static void _dump_copy_slot_done(dump_copy_ctx* ctx, u32 slot)
+{
+    u32 done = slot * DUMP_RING_SLOT_SECTORS;
+    if((done % 0x10000) == 0 || slot == ctx->total_slots) {
+        u32 now = read32(LT_TIMER);
+        ctx->ticks += now - ctx->last_tick;
+        ctx->last_tick = now;
+        printf("%s: Sector 0x%08lX completed\n", ctx->name, min(done, ctx->total_sectors));
+    }
+}
+
+/* Compares a slot with what the destination already holds, *same is set if nothing needs
+   writing. Returns the error of a pending zero run that had to be written out first. */
+static int _dump_copy_check_slot(dump_copy_ctx* ctx, u32 slot, const u8* data, bool* same)
+{
+    u32 sector = slot * DUMP_RING_SLOT_SECTORS;
+    u32 count = _dump_copy_slot_sectors(slot, ctx->total_sectors);
+    u32 len = count * SDMMC_DEFAULT_BLOCKLEN;
+    int res = 0;
+
+    *same = !memcmp(data, ctx->scratch, len);
+
+    if(ctx->erase_ok && _dump_copy_is_zero(data, len)) {
+        if(ctx->zero_count && ctx->zero_start + ctx->zero_count != sector)
+            res = _dump_copy_flush_zero(ctx);
+        if(!ctx->zero_count) {
+            ctx->zero_start = sector;
+            ctx->zero_dirty = false;
+        }
+        ctx->zero_count += count;
+        ctx->zero_dirty |= !*same;
+        *same = true;
+        return res;
+    }
+
+    res = _dump_copy_flush_zero(ctx);
+    if(*same)
+        ctx->skipped += count;
+    return res;
+}
 
-    u8* sector_buf1 = memalign(32, SDMMC_DEFAULT_BLOCKLEN * SDHC_BLOCK_COUNT_MAX);
-    u8* sector_buf2 = memalign(32, SDMMC_DEFAULT_BLOCKLEN * SDHC_BLOCK_COUNT_MAX);
+static void _dump_copy_print_rate(dump_copy_ctx* ctx)
+{
+    u64 ticks = ctx->ticks ? ctx->ticks : 1;
+    // LT_TIMER runs at 1.9MHz
+    u32 tenths = (u32)(((u64)ctx->total_sectors * SDMMC_DEFAULT_BLOCKLEN * 19) / ticks);
+    printf("%s: 0x%08lX sectors in %lus, %lu.%lu MB/s\n", ctx->name, ctx->total_sectors,
+           (u32)(ticks / 1900000), tenths / 10, tenths % 10);
+    if(ctx->verify)
+        printf("%s: %lu MiB written, %lu MiB unchanged, %lu MiB erased\n", ctx->name,
+               ctx->written / 2048, ctx->skipped / 2048, ctx->erased / 2048);
+}
+
+/* Copies total_sectors from src to dst. With verify (a reader for dst), every slot is first
+   read back from dst and only written if it differs; if dst can erase, runs of zeros are
+   erased instead of written. */
+static int _dump_copy_ring(const dump_copy_dev* src, const dump_copy_dev* dst, const dump_copy_dev* verify,
+                           u32 total_sectors, const char* name)
+{
+    const u32 slot_bytes = DUMP_RING_SLOT_SECTORS * SDMMC_DEFAULT_BLOCKLEN;
+    u8* ring[DUMP_RING_SLOTS];
+    u32 slots = 0;
+    int res = 0;
+
+    dump_copy_ctx ctx = {
+        .name = name, .dst = dst, .verify = verify,
+        .total_sectors = total_sectors,
+        .total_slots = (total_sectors + DUMP_RING_SLOT_SECTORS - 1) / DUMP_RING_SLOT_SECTORS,
+    };
+
+    if(verify) {
+        // without a known erase group size zeros are written like everything else
+        ctx.erase_group = dst->erase && dst->erase_sectors ? dst->erase_sectors() : 0;
+        ctx.erase_ok = ctx.erase_group != 0;
+        if(dst->erase && !ctx.erase_ok)
+            printf("%s: erase group size unknown, not erasing\n", name);
+
+        ctx.scratch = memalign(32, slot_bytes);
+        if(ctx.erase_ok)
+            ctx.zeros = memalign(32, slot_bytes);
+        if(!ctx.scratch || (ctx.erase_ok && !ctx.zeros)) {
+            printf("%s: not enough memory for copy buffers\n", name);
+            res = -1;
+            goto out;
+        }
+        if(ctx.zeros)
+            memset(ctx.zeros, 0, slot_bytes);
+    }
+
+    // take what memory allows, two buffers is the old double buffering
+    while(slots < DUMP_RING_SLOTS && (ring[slots] = memalign(32, slot_bytes)))
+        slots++;
+    if(slots < 2) {
+        printf("%s: not enough memory for copy buffers\n", name);
+        res = -1;
+        goto out;
+    }
 
-    u8* mlc_buf = sector_buf2;
-    u8* sdcard_buf = sector_buf1;
+    dump_copy_side rd = { .dev = src, .max = min(src->max_blocks(), DUMP_RING_SLOT_SECTORS) };
+    dump_copy_side wr = { .dev = dst, .max = min(dst->max_blocks(), DUMP_RING_SLOT_SECTORS) };
+    dump_copy_side vr = { .dev = verify, .max = verify ? min(verify->max_blocks(), DUMP_RING_SLOT_SECTORS) : 1 };
+    rd.chunk = rd.max;
+    wr.chunk = wr.max;
+    vr.chunk = vr.max;
 
-    // Fill one of the buffers in advance, so SD card has something to work with.
-    do res = mlc_read(0, SDHC_BLOCK_COUNT_MAX, sdcard_buf);
-    while(res);
+    ctx.last_tick = read32(LT_TIMER);
 
-    // Do one less iteration than we need, due to having to special case the start and end.
-    u32 sdcard_sector = base;
-    for(u32 sector = SDHC_BLOCK_COUNT_MAX; sector < TOTAL_SECTORS; sector += SDHC_BLOCK_COUNT_MAX)
+    while(wr.slot < ctx.total_slots)
     {
-        int complete = 0;
-        // Make sure to retry until the command succeeded, probably superfluous but harmless...
-        while(complete != 0b11) {
-            // Issue commands if we didn't already complete them.
-            if(!(complete & 0b01))
-                mres = mlc_start_read(sector, SDHC_BLOCK_COUNT_MAX, mlc_buf, &mlc_cmd);
-            if(!(complete & 0b10))
-                sres = sdcard_start_write(sdcard_sector, SDHC_BLOCK_COUNT_MAX, sdcard_buf, &sdcard_cmd);
-
-            // Only end the command if starting it succeeded.
-            // If starting and ending the command succeeds, mark it as complete.
-            if(!(complete & 0b01) && mres == 0) {
-                mres = mlc_end_read(&mlc_cmd);
-                if(mres == 0) complete |= 0b01;
-            }
-            if(!(complete & 0b10) && sres == 0) {
-                sres = sdcard_end_write(&sdcard_cmd);
-                if(sres == 0) complete |= 0b10;
+        bool rd_idle = !rd.busy && rd.slot < ctx.total_slots && rd.slot - wr.slot < slots;
+        // read-back and write share the destination host
+        bool wr_idle = !wr.busy && !vr.busy && wr.slot < rd.slot;
+
+        // nothing to issue, spend the wait on queued log output
+        if(!rd_idle && !wr_idle)
+            log_poll();
+
+        if(rd_idle)
+            _dump_copy_issue(&rd, ring[rd.slot % slots], total_sectors);
+
+        if(wr_idle) {
+            if(verify && vr.slot == wr.slot)
+                _dump_copy_issue(&vr, ctx.scratch, total_sectors);
+            else
+                _dump_copy_issue(&wr, ring[wr.slot % slots], total_sectors);
+        }
+
+        if(rd.busy && _dump_copy_ready(&rd))
+            _dump_copy_complete(&rd, total_sectors);
+
+        if(vr.busy && _dump_copy_ready(&vr) && _dump_copy_complete(&vr, total_sectors)) {
+            u32 start = read32(LT_TIMER);
+            bool same;
+            // zero fills are already retried by _dump_copy_sync, give up
+            res = _dump_copy_check_slot(&ctx, wr.slot, ring[wr.slot % slots], &same);
+            if(res)
+                break;
+            // erases and zero fills block, don't bill them to the read in flight
+            if(rd.busy)
+                rd.issued += read32(LT_TIMER) - start;
+            if(same) {
+                wr.slot++;
+                _dump_copy_slot_done(&ctx, wr.slot);
             }
         }
 
-        // Swap buffers.
-        if(mlc_buf == sector_buf1) {
-            mlc_buf = sector_buf2;
-            sdcard_buf = sector_buf1;
-        } else {
-            mlc_buf = sector_buf1;
-            sdcard_buf = sector_buf2;
+        if(wr.busy && _dump_copy_ready(&wr) && _dump_copy_complete(&wr, total_sectors)) {
+            ctx.written += _dump_copy_slot_sectors(wr.slot - 1, total_sectors);
+            _dump_copy_slot_done(&ctx, wr.slot);
         }
 
-        sdcard_sector += SDHC_BLOCK_COUNT_MAX;
+        res = rd.failed ? rd.failed : wr.failed ? wr.failed : vr.failed;
+        if(res)
+            break;
+    }
 
-        if((sector % 0x10000) == 0) {
-            printf("MLC: Sector 0x%08lX completed\n", sector);
-        }
+    // an aborted copy still has to wait for the commands in flight before freeing their buffers
+    if(rd.busy)
+        _dump_copy_complete(&rd, total_sectors);
+    if(wr.busy)
+        _dump_copy_complete(&wr, total_sectors);
+    if(vr.busy)
+        _dump_copy_complete(&vr, total_sectors);
+    if(res) {
+        printf("%s: copy aborted (%d)\n", name, res);
+        goto out;
     }
 
-    // Finish up the last iteration.
-    do res = sdcard_write(sdcard_sector, SDHC_BLOCK_COUNT_MAX, sdcard_buf);
-    while(res);
+    if(verify)
+        res = _dump_copy_flush_zero(&ctx);
 
-    free(sector_buf1);
-    free(sector_buf2);
+    _dump_copy_print_rate(&ctx);
+    if(rd.errors || wr.errors || vr.errors)
+        printf("%s: %lu read errors, %lu write errors (all retried)\n", name, rd.errors + vr.errors, wr.errors);
 
-    return 0;
+out:
+    while(slots)
+        free(ring[--slots]);
+    free(ctx.scratch);
+    free(ctx.zeros);
+    return res;
 }
 
-int _dump_restore_mlc(u32 base)
+int _dump_mlc(u32 base, bool changed_only)
 {
     sdcard_ack_card();
     if(sdcard_check_card() != SDMMC_INSERTED) {
@@ -860,42 +1239,73 @@ int _dump_restore_mlc(u32 base)
     }
 
     if(mlc_init())
-        return -2;
+        return -1;
 
-    int res = 0, mres = 0, sres = 0;
     if(base == 0) return -2;
 
-    // This uses "async" read/write functions, combined with double buffering to achieve a
-    // much faster dump. This works because these are two separate host controllers using DMA.
-    // Instead of running a single command and waiting for completion, we queue both commands
-    // and then wait for them both to complete at the end of each iteration.
-    struct sdmmc_command mlc_cmd = {0}, sdcard_cmd = {0};
+    // Both are separate host controllers using DMA, so the transfers run concurrently.
+    const dump_copy_dev mlc = { "MLC", mlc_start_read, mlc_end_read, mlc_async_done, mlc_max_blocks, 0 };
+    const dump_copy_dev sd = { "SD", sdcard_start_write, sdcard_end_write, sdcard_async_done, sdcard_max_blocks, base };
+    const dump_copy_dev sd_verify = { "SD", sdcard_start_read, sdcard_end_read, sdcard_async_done, sdcard_max_blocks, base };
+
+    return _dump_copy_ring(&mlc, &sd, changed_only ? &sd_verify : NULL, TOTAL_SECTORS, "MLC");
+}
+
+int _dump_restore_mlc(u32 base, bool changed_only)
+{
+    sdcard_ack_card();
+    if(sdcard_check_card() != SDMMC_INSERTED) {
+        printf("SD card is not initialized.\n");
+        return -1;
+    }
+
+    if(mlc_init())
+        return -2;
+
+    int res = 0;
+    if(base == 0) return -2;
 
-    u8* sector_buf1 = memalign(32, SDMMC_DEFAULT_BLOCKLEN * SDHC_BLOCK_COUNT_MAX);
-    u8* sector_buf2 = memalign(32, SDMMC_DEFAULT_BLOCKLEN * SDHC_BLOCK_COUNT_MAX);
+    u8* sd_buf = memalign(32, SDMMC_DEFAULT_BLOCKLEN * SDHC_BLOCK_COUNT_MAX);
+    u8* mlc_buf = memalign(32, SDMMC_DEFAULT_BLOCKLEN * SDHC_BLOCK_COUNT_MAX);
+    if(!sd_buf || !mlc_buf) {
+        free(sd_buf);
+        free(mlc_buf);
+        return -5;
+    }
 
-    u8* mlc_buf = sector_buf2;
-    u8* sdcard_buf = sector_buf1;
+    // Read the first block of both to compare against for safety checks.
+    int tries = 0;
+    do res = sdcard_read(base, SDHC_BLOCK_COUNT_MAX, sd_buf);
+    while(res && ++tries < DUMP_SD_RETRIES);
 
-    // Fill one of the buffers in advance, so SD card has something to work with.
-    do res = sdcard_read(base, SDHC_BLOCK_COUNT_MAX, mlc_buf);
-    while(res);
+    if(!res) {
+        tries = 0;
+        do res = mlc_read(0, SDHC_BLOCK_COUNT_MAX, mlc_buf);
+        while(res && ++tries < DUMP_SD_RETRIES);
+    }
 
-    // Read first block from MLC to compare against for safety checks.
-    do res = mlc_read(0, SDHC_BLOCK_COUNT_MAX, sdcard_buf);
-    while(res);
+    if(res) {
+        printf("MLC: Failed to read the first block (%d)!\n", res);
+        free(sd_buf);
+        free(mlc_buf);
+        return res;
+    }
 
     bool allzero = true;
     for(size_t i = 0; i < SDMMC_DEFAULT_BLOCKLEN * SDHC_BLOCK_COUNT_MAX; i++){
-        if(mlc_buf[i]){
+        if(sd_buf[i]){
             allzero = false;
             break;
         }
     }
+    bool match = !memcmp(mlc_buf, sd_buf, SDMMC_DEFAULT_BLOCKLEN * SDHC_BLOCK_COUNT_MAX);
+    free(sd_buf);
+    free(mlc_buf);
+
     // Check to see if the first block matches, if so, ask the user if they want to continue.
     if(allzero){
         printf("MLC: First block is empty, continue restoring?\n");
-    } else if(memcmp(sdcard_buf, mlc_buf, SDMMC_DEFAULT_BLOCKLEN * SDHC_BLOCK_COUNT_MAX) == 0) {
+    } else if(match) {
         printf("MLC: First blocks match, continue restoring?\n");
     } else {
         printf("MLC: First blocks do not match!\n");
@@ -906,74 +1316,64 @@ int _dump_restore_mlc(u32 base)
         return -4;
     printf("MLC: Continuing restore...\n");
 
-    // Do one less iteration than we need, due to having to special case the start and end.
-    u32 sdcard_sector = base + SDHC_BLOCK_COUNT_MAX;
-    u32 mlc_sector = 0;
+    const dump_copy_dev sd = { "SD", sdcard_start_read, sdcard_end_read, sdcard_async_done, sdcard_max_blocks, base };
+    const dump_copy_dev mlc = { "MLC", mlc_start_write, mlc_end_write, mlc_async_done, mlc_max_blocks, 0, mlc_do_erase, mlc_erase_sectors };
+    const dump_copy_dev mlc_verify = { "MLC", mlc_start_read, mlc_end_read, mlc_async_done, mlc_max_blocks, 0 };
 
-    while(mlc_sector < (TOTAL_SECTORS - SDHC_BLOCK_COUNT_MAX))
-    {
-        int complete = 0;
-        int retries = 0;
-        // Make sure to retry until the command succeeded, probably superfluous but harmless...
-        while(complete != 0b11) {
-            // Issue commands if we didn't already complete them.
-            if(!(complete & 0b01))
-                sres = sdcard_start_read(sdcard_sector, SDHC_BLOCK_COUNT_MAX, sdcard_buf, &sdcard_cmd);
-            if(!(complete & 0b10))
-                mres = mlc_start_write(mlc_sector, SDHC_BLOCK_COUNT_MAX, mlc_buf, &mlc_cmd);
-
-            // Only end the command if starting it succeeded.
-            // If starting and ending the command succeeds, mark it as complete.
-            if(!(complete & 0b01) && sres == 0) {
-                sres = sdcard_end_read(&sdcard_cmd);
-                if(sres == 0) complete |= 0b01;
-            }
-            if(!(complete & 0b10) && mres == 0) {
-                mres = mlc_end_write(&mlc_cmd);
-                if(mres == 0) complete |= 0b10;
-            }
-
-            if (retries > 9999999) {
-                printf("MLC: Still working on sector 0x%08lX\n", mlc_sector);
-                retries = 0;
-            }
-
-            retries++;
-        }
-
-        // Swap buffers.
-        if(mlc_buf == sector_buf1) {
-            mlc_buf = sector_buf2;
-            sdcard_buf = sector_buf1;
-        } else {
-            mlc_buf = sector_buf1;
-            sdcard_buf = sector_buf2;
-        }
+    return _dump_copy_ring(&sd, &mlc, changed_only ? &mlc_verify : NULL, TOTAL_SECTORS, "MLC");
+}
 
-        if((mlc_sector % 0x10000) == 0) {
-            printf("MLC: Sector 0x%08lX written\n", mlc_sector);
-        }
+static bool _dump_slc_is_erased(const u8* buf, u32 len)
+{
+    const u32* words = (const u32*)buf;
+    for(u32 i = 0; i < len / sizeof(u32); i++)
+        if(words[i] != 0xFFFFFFFF) return false;
+    return true;
+}
 
-        sdcard_sector += SDHC_BLOCK_COUNT_MAX;
-        mlc_sector += SDHC_BLOCK_COUNT_MAX;
+/* Returns 1 and fills blocks (NAND_SPARSE_BLOCKS entries) for a sparse image, 0 for a
+   flat one, negative if the sparse header doesn't match the file. Leaves the file
+   positioned at the first page. */
+static int _dump_slc_sparse_load(FIL* file, nand_sparse_hdr* hdr, u16* blocks)
+{
+    UINT btx = 0;
+    FRESULT fres = f_read(file, hdr, sizeof(*hdr), &btx);
+    if(fres != FR_OK) {
+        printf("Failed to read image header (%d).\n", fres);
+        return -1;
     }
+    if(btx != sizeof(*hdr) || hdr->magic != NAND_SPARSE_MAGIC)
+        return f_rewind(file) == FR_OK ? 0 : -1;
 
-    // Finish up the last iteration.
-    do res = mlc_write(mlc_sector, SDHC_BLOCK_COUNT_MAX, mlc_buf);
-    while(res);
+    if(hdr->version != NAND_SPARSE_VERSION || hdr->total_pages > NAND_MAX_PAGE ||
+       hdr->total_pages % BLOCK_PAGES) {
+        printf("Unsupported sparse image (version %lu, 0x%lX pages).\n", hdr->version, hdr->total_pages);
+        return -1;
+    }
 
-    free(sector_buf1);
-    free(sector_buf2);
+    u32 slot = 0;
+    for(u32 block = 0; block < NAND_SPARSE_BLOCKS; block++) {
+        bool stored = block < hdr->total_pages / BLOCK_PAGES && (hdr->bitmap[block / 8] & (1 << (block % 8)));
+        blocks[block] = stored ? slot++ : NAND_SPARSE_ERASED;
+    }
 
-    return 0;
+    u64 size_expected = NAND_SPARSE_HDR_SIZE + (u64)slot * NAND_RAW_BLOCK_SIZE;
+    if(slot != hdr->stored_blocks || f_size(file) != size_expected) {
+        printf("Sparse image is truncated (%lu blocks, expected 0x%llx bytes).\n", hdr->stored_blocks, size_expected);
+        return -1;
+    }
+    return 1;
 }
 
-int _dump_slc_raw(u32 bank, int boot1_only)
+int _dump_slc_raw(u32 bank, int boot1_only, bool sparse)
 {
-    #define PAGES_PER_ITERATION (0x10)
+    #define PAGES_PER_ITERATION (BLOCK_PAGES)
     #define TOTAL_ITERATIONS ((boot1_only ? BOOT1_MAX_PAGE : NAND_MAX_PAGE) / PAGES_PER_ITERATION)
 
-    static u8 file_buf[PAGES_PER_ITERATION][PAGE_SIZE + PAGE_SPARE_SIZE];
+    static u8 file_buf[PAGES_PER_ITERATION][PAGE_SIZE + PAGE_SPARE_SIZE] ALIGNED(32);
+    static nand_sparse_hdr sparse_hdr ALIGNED(32);
+    static u8 page_bufs[2][PAGE_SIZE] ALIGNED(NAND_DATA_ALIGN);
+    static u8 ecc_bufs[2][ECC_BUFFER_ALLOC] ALIGNED(NAND_DATA_ALIGN);
 
     sdcard_ack_card();
     if(sdcard_check_card() != SDMMC_INSERTED) {
@@ -1003,33 +1403,79 @@ int _dump_slc_raw(u32 bank, int boot1_only)
         return -3;
     }
 
+    const u32 total_pages = PAGES_PER_ITERATION * TOTAL_ITERATIONS;
+
+    // the header is written again with the final bitmap at the end
+    if(sparse) {
+        memset(&sparse_hdr, 0, sizeof(sparse_hdr));
+        sparse_hdr.magic = NAND_SPARSE_MAGIC;
+        sparse_hdr.version = NAND_SPARSE_VERSION;
+        sparse_hdr.total_pages = total_pages;
+        fres = f_write(&file, &sparse_hdr, sizeof(sparse_hdr), &btx);
+        if(fres != FR_OK || btx != sizeof(sparse_hdr)) {
+            f_close(&file);
+            printf("Failed to write %s (%d).\n", path, fres);
+            return -4;
+        }
+    }
+
     printf("Initializing %s...\n", name);
     nand_initialize(bank);
 
+    // the next page is already transferring while the current one is corrected and copied,
+    // and keeps doing so while the batch gets written out
+    nand_start_read_page(0, page_bufs[0], ecc_bufs[0]);
+
     for(u32 i = 0; i < TOTAL_ITERATIONS; i++)
     {
         u32 page_base = i * PAGES_PER_ITERATION;
         for(u32 page = 0; page < PAGES_PER_ITERATION; page++)
         {
-            nand_read_page(page_base + page, nand_page_buf, nand_ecc_buf);
-            nand_correct(page_base + page, nand_page_buf, nand_ecc_buf);
+            u32 cur = page_base + page, buf = cur & 1;
+            nand_end_read_page();
+            if(cur + 1 < total_pages)
+                nand_start_read_page(cur + 1, page_bufs[buf ^ 1], ecc_bufs[buf ^ 1]);
+            nand_correct(cur, page_bufs[buf], ecc_bufs[buf]);
+
+            memcpy(file_buf[page], page_bufs[buf], PAGE_SIZE);
+            memcpy(file_buf[page] + PAGE_SIZE, ecc_bufs[buf], PAGE_SPARE_SIZE);
+        }
 
-            memcpy(file_buf[page], nand_page_buf, PAGE_SIZE);
-            memcpy(file_buf[page] + PAGE_SIZE, nand_ecc_buf, PAGE_SPARE_SIZE);
+        // a batch is one block, fully erased ones are left out of sparse images
+        if(sparse) {
+            if(_dump_slc_is_erased((u8*)file_buf, sizeof(file_buf)))
+                goto next;
+            sparse_hdr.bitmap[i / 8] |= 1 << (i % 8);
+            sparse_hdr.stored_blocks++;
         }
 
         fres = f_write(&file, file_buf, sizeof(file_buf), &btx);
         if(fres != FR_OK || btx != sizeof(file_buf)) {
+            if(page_base + PAGES_PER_ITERATION < total_pages)
+                nand_end_read_page();
             f_close(&file);
             printf("Failed to write %s (%d).\n", path, fres);
             return -4;
         }
 
-        if((i % 0x100) == 0) {
+next:
+        if((i % 0x40) == 0) {
             printf("%s-RAW: Page 0x%05lX / 0x%05lX completed\n", name, page_base, PAGES_PER_ITERATION * TOTAL_ITERATIONS);
         }
     }
 
+    if(sparse) {
+        printf("%s-RAW: %lu of %lu blocks stored\n", name, sparse_hdr.stored_blocks, (u32)TOTAL_ITERATIONS);
+        fres = f_lseek(&file, 0);
+        if(fres == FR_OK)
+            fres = f_write(&file, &sparse_hdr, sizeof(sparse_hdr), &btx);
+        if(fres != FR_OK || btx != sizeof(sparse_hdr)) {
+            f_close(&file);
+            printf("Failed to write %s (%d).\n", path, fres);
+            return -4;
+        }
+    }
+
     fres = f_close(&file);
     if(fres != FR_OK) {
         printf("Failed to close %s (%d).\n", path, fres);
@@ -1083,9 +1529,13 @@ static bool check_all32(u8* arr, u32 length, u8 value){
     return false;
 }
 
-static u8* dump_get_new_super(FIL *f, isfs_ctx *ctx, bool *same_slots){
+static u8* dump_get_new_super(FIL *f, u16 *file_blocks, isfs_ctx *ctx, bool *same_slots){
     isfs_ctx file_ctx = *ctx;
     file_ctx.file = f;
+    file_ctx.file_blocks = file_blocks;
+    file_ctx.cache = NULL;
+    file_ctx.lookup = NULL;
+    file_ctx.supers_valid = false;
     file_ctx.super = memalign(NAND_DATA_ALIGN, ISFSSUPER_SIZE);
     int res = isfs_load_super(&file_ctx);
     if(res){
@@ -1106,6 +1556,33 @@ static u8* dump_get_new_super(FIL *f, isfs_ctx *ctx, bool *same_slots){
     return file_ctx.super;
 }
 
+// reads a block raw and compares pages and spare with the image, stops at the first difference
+static bool _dump_slc_block_matches(u32 page_base, const u8* block)
+{
+    static u8 page_bufs[2][PAGE_SIZE] ALIGNED(NAND_DATA_ALIGN);
+    static u8 ecc_bufs[2][ECC_BUFFER_ALLOC] ALIGNED(NAND_DATA_ALIGN);
+
+    nand_start_read_page(page_base, page_bufs[0], ecc_bufs[0]);
+    for(u32 page = 0; page < BLOCK_PAGES; page++)
+    {
+        u32 buf = page & 1;
+        const u8* expected = block + page * NAND_RAW_PAGE_STRIDE;
+
+        if(nand_end_read_page() < 0)
+            return false;
+        if(page + 1 < BLOCK_PAGES)
+            nand_start_read_page(page_base + page + 1, page_bufs[buf ^ 1], ecc_bufs[buf ^ 1]);
+
+        if(memcmp(page_bufs[buf], expected, PAGE_SIZE) ||
+           memcmp(ecc_bufs[buf], expected + PAGE_SIZE, PAGE_SPARE_SIZE)) {
+            if(page + 1 < BLOCK_PAGES)
+                nand_end_read_page();
+            return false;
+        }
+    }
+    return true;
+}
+
 int _dump_restore_slc_raw(u32 bank, int boot1_only, bool nand_test)
 {
     int ret = 0;
@@ -1116,7 +1593,9 @@ int _dump_restore_slc_raw(u32 bank, int boot1_only, bool nand_test)
 
 
     static u8 page_buf[PAGE_STRIDE] ALIGNED(64);
-    static u8 file_buf[FILE_BUF_SIZE];
+    static u8 file_buf[FILE_BUF_SIZE] ALIGNED(32);
+    static nand_sparse_hdr sparse_hdr ALIGNED(32);
+    static u16 sparse_blocks[NAND_SPARSE_BLOCKS];
 
     sdcard_ack_card();
     if(sdcard_check_card() != SDMMC_INSERTED) {
@@ -1166,6 +1645,13 @@ int _dump_restore_slc_raw(u32 bank, int boot1_only, bool nand_test)
     printf("Write sdmc:/%s to %s?\n", path, name);
     if (console_abort_confirmation_power_no_eject_yes()) return 0;
 
+    // the NAND test needs every block erased and programmed
+    bool changed_only = false;
+    if(!nand_test) {
+        printf("Only rewrite blocks that differ from %s?\n", name);
+        changed_only = !console_abort_confirmation_power_no_eject_yes();
+    }
+
     FIL file = {0}; FRESULT fres = 0; UINT btx = 0;
     fres = f_open(&file, path, FA_READ);
     if(fres != FR_OK) {
@@ -1173,15 +1659,16 @@ int _dump_restore_slc_raw(u32 bank, int boot1_only, bool nand_test)
         return -3;
     }
 
-    fres = f_read(&file, file_buf, PAGE_STRIDE, &btx);
-    if(fres != FR_OK || btx != PAGE_STRIDE) {
+    int sparse = _dump_slc_sparse_load(&file, &sparse_hdr, sparse_blocks);
+    if(sparse < 0) {
         f_close(&file);
-        printf("Failed to read %s (%d).\n", path, fres);
+        printf("Failed to read %s.\n", path);
         return -4;
     }
 
+    // sparse images are checked against the size of the flat image they stand for
     u64 nand_file_size_expected = (boot1_only ? BOOT1_MAX_PAGE : NAND_MAX_PAGE) * PAGE_STRIDE;
-    u64 nand_file_size = f_size(&file);
+    u64 nand_file_size = sparse ? (u64)sparse_hdr.total_pages * PAGE_STRIDE : f_size(&file);
     if (nand_file_size != nand_file_size_expected && boot1_only && nand_file_size * 2 == nand_file_size_expected) {
         nand_file_size_expected /= 2;
         boot1_is_half = 1;
@@ -1198,7 +1685,7 @@ int _dump_restore_slc_raw(u32 bank, int boot1_only, bool nand_test)
         isfs_fini();
     } else {
         bool same_slots;
-        u8 *new_super = dump_get_new_super(&file, ctx, &same_slots);
+        u8 *new_super = dump_get_new_super(&file, sparse ? sparse_blocks : NULL, ctx, &same_slots);
         if(!new_super){
             printf("Error finding supberblock in %s\n", name);
             return -6;
@@ -1222,7 +1709,7 @@ int _dump_restore_slc_raw(u32 bank, int boot1_only, bool nand_test)
         }
     }
 
-    fres = f_rewind(&file);
+    fres = f_lseek(&file, sparse ? NAND_SPARSE_HDR_SIZE : 0);
     if(fres != FR_OK) {
         f_close(&file);
         printf("Failed to rewind %s (%d).\n", path, fres);
@@ -1237,14 +1724,22 @@ int _dump_restore_slc_raw(u32 bank, int boot1_only, bool nand_test)
     u32 erase_test_failed = 0;
     u32 erase_test_failed_blocks = 0;
     u32 program_failed = 0;
+    u32 blocks_skipped = 0;
+    u32 blocks_rewritten = 0;
+    u32 blocks_failed = 0;
 
 
     for(u32 page_base=0; page_base < total_pages; page_base += BLOCK_PAGES){
-        fres = f_read(&file, file_buf, FILE_BUF_SIZE, &btx);
-        if(fres != FR_OK || btx != min(FILE_BUF_SIZE, (total_pages-page_base) * PAGE_STRIDE)) {
-            f_close(&file);
-            printf("Failed to read %s (%d).\n", path, fres);
-            return -4;
+        if(sparse && sparse_blocks[page_base / BLOCK_PAGES] == NAND_SPARSE_ERASED) {
+            // not in the image, the block is restored erased
+            memset(file_buf, 0xFF, FILE_BUF_SIZE);
+        } else {
+            fres = f_read(&file, file_buf, FILE_BUF_SIZE, &btx);
+            if(fres != FR_OK || btx != min(FILE_BUF_SIZE, (total_pages-page_base) * PAGE_STRIDE)) {
+                f_close(&file);
+                printf("Failed to read %s (%d).\n", path, fres);
+                return -4;
+            }
         }
 
         if(protect_isfshax){
@@ -1258,6 +1753,11 @@ int _dump_restore_slc_raw(u32 bank, int boot1_only, bool nand_test)
             }
         }
 
+        if(changed_only && _dump_slc_block_matches(page_base, file_buf)){
+            blocks_skipped++;
+            goto block_done;
+        }
+
         if(nand_test){
             bool is_badblock = false;
             //Test if page can be fully programmed to 0
@@ -1303,6 +1803,7 @@ int _dump_restore_slc_raw(u32 bank, int boot1_only, bool nand_test)
             }
         }
 
+        bool block_failed = false;
         for(u32 page=0; page < BLOCK_PAGES; page++){
             memcpy(nand_page_buf, &file_buf[page*PAGE_STRIDE], PAGE_STRIDE);
             memcpy(nand_ecc_buf, &file_buf[(page*PAGE_STRIDE) + PAGE_SIZE], PAGE_SPARE_SIZE);
@@ -1330,9 +1831,16 @@ int _dump_restore_slc_raw(u32 bank, int boot1_only, bool nand_test)
 
             if (memcmp(nand_page_buf, &file_buf[page*PAGE_STRIDE], PAGE_STRIDE)) {
                 printf("Failed to program page: 0x%05lX\n", page_base + page);
+                program_failed++;
+                block_failed = true;
             }
         }
+        if(block_failed)
+            blocks_failed++;
+        else
+            blocks_rewritten++;
 
+block_done:
         if((page_base % (BLOCK_PAGES * 0x10)) == 0) 
         {
             printf("%s-RAW: Page 0x%05lX / 0x%05lX completed\n", name, page_base, total_pages);
@@ -1346,6 +1854,10 @@ int _dump_restore_slc_raw(u32 bank, int boot1_only, bool nand_test)
         ret = -5;
     }
 
+    // the volume stayed mounted, drop anything cached from the old contents
+    if(protect_isfshax)
+        isfs_cache_invalidate(ctx, 0, CLUSTER_COUNT);
+
     if(nand_test){
         printf("%u pages in %u blocks failed program test\n", 
                     program_test_failed, program_test_failed_blocks);
@@ -1353,6 +1865,7 @@ int _dump_restore_slc_raw(u32 bank, int boot1_only, bool nand_test)
                     erase_test_failed, erase_test_failed_blocks);
     }
     printf("%u pages failed to program\n", program_failed);
+    printf("%lu blocks unchanged, %lu rewritten, %lu failed\n", blocks_skipped, blocks_rewritten, blocks_failed);
 
     _dump_sync_seeprom_boot1_versions();
 
@@ -1369,7 +1882,7 @@ int _dump_restore_slc_img(u32 bank, int boot1_only)
 
     #define FILE_BUF_SIZE (BLOCK_PAGES * PAGE_SIZE)
 
-    static u8 file_buf[FILE_BUF_SIZE];
+    static u8 file_buf[FILE_BUF_SIZE] ALIGNED(32);
 
     sdcard_ack_card();
     if(sdcard_check_card() != SDMMC_INSERTED) {
@@ -1488,6 +2001,7 @@ int _dump_slc_to_sdcard_sectors(u32 base, u32 bank)
     #define TOTAL_ITERATIONS (NAND_MAX_PAGE / PAGES_PER_ITERATION)
 
     static u8 page_buf[PAGES_PER_ITERATION][PAGE_SIZE] ALIGNED(NAND_DATA_ALIGN);
+    static u8 ecc_bufs[2][ECC_BUFFER_ALLOC] ALIGNED(NAND_DATA_ALIGN);
 
     sdcard_ack_card();
     if(sdcard_check_card() != SDMMC_INSERTED) {
@@ -1508,26 +2022,39 @@ int _dump_slc_to_sdcard_sectors(u32 base, u32 bank)
     printf("Initializing %s...\n", name);
     nand_initialize(bank);
 
-    u32 sdcard_sector = base;
+    sdcard_stream stream;
+    if(sdcard_stream_open(&stream, base, NAND_MAX_PAGE * SECTORS_PER_PAGE))
+        return -4;
+
     for(u32 i = 0; i < TOTAL_ITERATIONS; i++)
     {
         u32 page_base = i * PAGES_PER_ITERATION;
+        // page_buf is busy with the SD write in between, so the pipeline restarts every batch
+        nand_start_read_page(page_base, page_buf[0], ecc_bufs[0]);
         for(u32 page = 0; page < PAGES_PER_ITERATION; page++)
         {
-            nand_read_page(page_base + page, page_buf[page], nand_ecc_buf);
-            nand_correct(page_base + page, page_buf[page], nand_ecc_buf);
+            nand_end_read_page();
+            if(page + 1 < PAGES_PER_ITERATION)
+                nand_start_read_page(page_base + page + 1, page_buf[page + 1], ecc_bufs[(page + 1) & 1]);
+            nand_correct(page_base + page, page_buf[page], ecc_bufs[page & 1]);
         }
 
-        do res = sdcard_write(sdcard_sector, SECTORS_PER_ITERATION, page_buf);
-        while(res);
+        int tries = 0;
+        do res = sdcard_stream_write(&stream, page_buf, SECTORS_PER_ITERATION);
+        while(res && ++tries < DUMP_SD_RETRIES);
 
-        sdcard_sector += SECTORS_PER_ITERATION;
+        if(res) {
+            printf("%s: Write of page 0x%05lX failed (%d)!\n", name, page_base, res);
+            sdcard_stream_close(&stream, name);
+            return res;
+        }
 
         if((i % 0x100) == 0) {
             printf("%s: Page 0x%05lX completed\n", name, page_base);
         }
     }
 
+    sdcard_stream_close(&stream, name);
     return 0;
 
     #undef SECTORS_PER_PAGE
@@ -1536,7 +2063,7 @@ int _dump_slc_to_sdcard_sectors(u32 base, u32 bank)
     #undef TOTAL_ITERATIONS
 }
 
-int _dump_copy_rednand(u32 slc_base, u32 slccmpt_base, u32 mlc_base)
+int _dump_copy_rednand(u32 slc_base, u32 slccmpt_base, u32 mlc_base, bool changed_only)
 {
     sdcard_ack_card();
     if(sdcard_check_card() != SDMMC_INSERTED) {
@@ -1548,22 +2075,26 @@ int _dump_copy_rednand(u32 slc_base, u32 slccmpt_base, u32 mlc_base)
         return -2;
     }
 
+    int res = 0;
+
     // Dump SLC.
     if(slc_base != 0) {
-        _dump_slc_to_sdcard_sectors(slc_base, NAND_BANK_SLC);
+        res = _dump_slc_to_sdcard_sectors(slc_base, NAND_BANK_SLC);
+        if(res) return res;
     }
 
     // Dump SLCCMPT.
     if(slccmpt_base != 0) {
-        _dump_slc_to_sdcard_sectors(slccmpt_base, NAND_BANK_SLCCMPT);
+        res = _dump_slc_to_sdcard_sectors(slccmpt_base, NAND_BANK_SLCCMPT);
+        if(res) return res;
     }
 
     // Dump MLC.
     if(mlc_base != 0) {
-        _dump_mlc(mlc_base);
+        res = _dump_mlc(mlc_base, changed_only);
     }
 
-    return 0;
+    return res;
 }
 
 int _dump_partition_rednand(void)
@@ -1699,7 +2230,7 @@ void dump_slc_raw(void)
     gfx_clear(GFX_ALL, BLACK);
     printf("Dumping SLC.RAW...\n");
 
-    res = _dump_slc_raw(NAND_BANK_SLC, 0);
+    res = _dump_slc_raw(NAND_BANK_SLC, 0, false);
     if(res) {
         printf("Failed to dump SLC.RAW (%d)!\n", res);
         goto slc_exit;
@@ -1716,7 +2247,41 @@ void dump_slccmpt_raw(void)
     gfx_clear(GFX_ALL, BLACK);
     printf("Dumping SLCCMPT.RAW...\n");
 
-    res = _dump_slc_raw(NAND_BANK_SLCCMPT, 0);
+    res = _dump_slc_raw(NAND_BANK_SLCCMPT, 0, false);
+    if(res) {
+        printf("Failed to dump SLCCMPT.RAW (%d)!\n", res);
+        goto slc_exit;
+    }
+
+slc_exit:
+    console_power_to_exit();
+}
+
+void dump_slc_raw_sparse(void)
+{
+    int res = 0;
+
+    gfx_clear(GFX_ALL, BLACK);
+    printf("Dumping sparse SLC.RAW...\n");
+
+    res = _dump_slc_raw(NAND_BANK_SLC, 0, true);
+    if(res) {
+        printf("Failed to dump SLC.RAW (%d)!\n", res);
+        goto slc_exit;
+    }
+
+slc_exit:
+    console_power_to_exit();
+}
+
+void dump_slccmpt_raw_sparse(void)
+{
+    int res = 0;
+
+    gfx_clear(GFX_ALL, BLACK);
+    printf("Dumping sparse SLCCMPT.RAW...\n");
+
+    res = _dump_slc_raw(NAND_BANK_SLCCMPT, 0, true);
     if(res) {
         printf("Failed to dump SLCCMPT.RAW (%d)!\n", res);
         goto slc_exit;
@@ -1733,7 +2298,7 @@ void dump_boot1_raw(void)
     gfx_clear(GFX_ALL, BLACK);
     printf("Dumping BOOT1_SLC.RAW...\n");
 
-    res = _dump_slc_raw(NAND_BANK_SLC, 1);
+    res = _dump_slc_raw(NAND_BANK_SLC, 1, false);
     if(res) {
         printf("Failed to dump BOOT1_SLC.RAW (%d)!\n", res);
         goto slc_exit;
@@ -1750,7 +2315,7 @@ void dump_boot1_vwii_raw(void)
     gfx_clear(GFX_ALL, BLACK);
     printf("Dumping BOOT1_SLCCMPT.RAW...\n");
 
-    res = _dump_slc_raw(NAND_BANK_SLCCMPT, 1);
+    res = _dump_slc_raw(NAND_BANK_SLCCMPT, 1, false);
     if(res) {
         printf("Failed to dump BOOT1_SLCCMPT.RAW (%d)!\n", res);
         goto slc_exit;
@@ -1920,14 +2485,14 @@ void dump_format_rednand(void)
     if(!console_abort_confirmation_power_skip_eject_dump())
     {
         printf("Dumping SLC-RAW to FAT32...\n");
-        res = _dump_slc_raw(NAND_BANK_SLC, 0);
+        res = _dump_slc_raw(NAND_BANK_SLC, 0, false);
         if(res) {
             printf("Failed to dump SLC-RAW (%d)!\n", res);
             goto format_exit;
         }
 
         printf("Dumping SLCCMPT-RAW to FAT32...\n");
-        res = _dump_slc_raw(NAND_BANK_SLCCMPT, 0);
+        res = _dump_slc_raw(NAND_BANK_SLCCMPT, 0, false);
         if(res) {
             printf("Failed to dump SLCCMPT-RAW (%d)!\n", res);
             goto format_exit;
@@ -1938,8 +2503,11 @@ void dump_format_rednand(void)
     u32 slc_base = LD_DWORD(mbr.partition[2].lba_start);
     u32 slccmpt_base = LD_DWORD(mbr.partition[3].lba_start);
 
+    printf("Only write MLC blocks that differ from the current redNAND?\n");
+    bool changed_only = !console_abort_confirmation_power_no_eject_yes();
+
     printf("Dumping redNAND...\n");
-    res = _dump_copy_rednand(slc_base, slccmpt_base, mlc_base);
+    res = _dump_copy_rednand(slc_base, slccmpt_base, mlc_base, changed_only);
     if(res) {
         printf("Failed to dump redNAND (%d)!\n", res);
         goto format_exit;
@@ -1995,8 +2563,11 @@ void dump_restore_rednand(void)
 
     smc_get_events(); // Eat all existing events
 
+    printf("Only write blocks that differ from the current MLC?\n");
+    bool changed_only = !console_abort_confirmation_power_no_eject_yes();
+
     printf("Restoring MLC...\n");
-    res = _dump_restore_mlc(rednand.mlc.lba_start);
+    res = _dump_restore_mlc(rednand.mlc.lba_start, changed_only);
     if(res) {
         printf("Failed to restore MLC (%d)!\n", res);
         goto restore_exit;
@@ -2342,6 +2913,7 @@ void dump_logs_slc(void){
         return;
     }
     _copy_dir("slc:/sys/logs", "sdmc:/logs");
+    isfs_print_cache_stats(ISFSVOL_SLC);
     console_power_or_eject_to_return();
 }
 
@@ -2363,6 +2935,7 @@ void dump_logs_redslc(void){
         return;
     }
     _copy_dir("redslc:/sys/logs", "sdmc:/redlogs");
+    isfs_print_cache_stats(ISFSVOL_REDSLC);
     console_power_or_eject_to_return();
 }
 
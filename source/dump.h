@@ -17,17 +17,19 @@ void dump_menu_show();
 
 void dump_restore_seeprom(void);
 
-int _dump_mlc(u32 base);
+int _dump_mlc(u32 base, bool changed_only);
 int _dump_slc(u32 base, u32 bank);
-int _dump_slc_raw(u32 bank, int boot1_only);
+int _dump_slc_raw(u32 bank, int boot1_only, bool sparse);
 void dump_erase_mlc(void);
-int _dump_restore_mlc(u32 base);
+int _dump_restore_mlc(u32 base, bool changed_only);
 
 int _dump_partition_rednand(void);
-int _dump_copy_rednand(u32 slc_base, u32 slccmpt_base, u32 mlc_base);
+int _dump_copy_rednand(u32 slc_base, u32 slccmpt_base, u32 mlc_base, bool changed_only);
 
 void dump_slc_raw(void);
 void dump_slccmpt_raw(void);
+void dump_slc_raw_sparse(void);
+void dump_slccmpt_raw_sparse(void);
 void dump_boot1_raw(void);
 void dump_boot1_vwii_raw(void);
 void dump_restore_slc_raw(void);
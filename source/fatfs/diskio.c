@@ -16,9 +16,25 @@
 #include "sdcard.h"
 #include "sdhc.h"
 #include "utils.h"
+#include "memory.h"
 
+#include <stdio.h>
+
+/* bounce buffer, only used when FatFs hands us something the SD DMA can't reach */
 static u8 buffer[SDMMC_DEFAULT_BLOCKLEN * SDHC_BLOCK_COUNT_MAX] ALIGNED(32);
 
+static struct {
+    u32 direct_reads, bounce_reads;
+    u32 direct_writes, bounce_writes;
+} disk_stats;
+
+void disk_print_stats(void)
+{
+    printf("diskio: sectors read %lu direct / %lu bounced, written %lu direct / %lu bounced\n",
+           disk_stats.direct_reads, disk_stats.bounce_reads,
+           disk_stats.direct_writes, disk_stats.bounce_writes);
+}
+
 /*-----------------------------------------------------------------------*/
 /* Get Disk Status                                                       */
 /*-----------------------------------------------------------------------*/
@@ -71,6 +87,15 @@ DRESULT disk_read (
 {
     (void)pdrv;
 
+    /* sdcard_read() splits by what the host can do in one command itself */
+    if(can_sdcard_dma_addr(buff)) {
+        disk_stats.direct_reads += count;
+        if(sdcard_read(sector, count, buff) != 0)
+            return RES_ERROR;
+        return RES_OK;
+    }
+
+    disk_stats.bounce_reads += count;
     while(count) {
         u32 work = min(count, SDHC_BLOCK_COUNT_MAX);
 
@@ -103,6 +128,14 @@ DRESULT disk_write (
 {
     (void)pdrv;
 
+    if(can_sdcard_dma_addr((void*)buff)) {
+        disk_stats.direct_writes += count;
+        if(sdcard_write(sector, count, (void*)buff) != 0)
+            return RES_ERROR;
+        return RES_OK;
+    }
+
+    disk_stats.bounce_writes += count;
     while(count) {
         u32 work = min(count, SDHC_BLOCK_COUNT_MAX);
 
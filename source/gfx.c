@@ -11,6 +11,7 @@
 #include "gfx.h"
 #include "serial.h"
 #include "gpu.h"
+#include "log.h"
 #include <stdio.h>
 #include <string.h>
 
@@ -49,6 +50,11 @@ void gfx_draw_string(gfx_screen_t screen, char* str, int x, int y, u32 color)
 
 }
 
+void gfx_console_write(const char* str)
+{
+
+}
+
 #ifndef MINUTE_BOOT1
 int printf(const char* fmt, ...)
 {
@@ -59,12 +65,7 @@ int printf(const char* fmt, ...)
 	vsnprintf(str, sizeof(str), fmt, va);
 	va_end(va);
 
-	char* str_iter = str;
-	while (*str_iter)
-	{
-		serial_send(*str_iter);
-		str_iter++;
-	}
+	log_puts(LOG_INFO, str);
 
     return 0;
 }
@@ -76,11 +77,30 @@ extern const u8 msx_font[];
 #define CHAR_SIZE_X (8)
 #define CHAR_SIZE_Y (8)
 
+#define GFX_MARGIN      (10)
+#define GFX_LINE_HEIGHT (10)
+#define GFX_BURST_WORDS (8)
+
+// struct copies of these compile to LDM/STM bursts
+typedef struct {
+	u32 w[GFX_BURST_WORDS];
+} gfx_burst;
+
+typedef struct {
+	u32 w[CHAR_SIZE_X / 2];
+} gfx_span;
+
 struct {
 	u32* ptr;
 	int width;
 	int height;
 	size_t bpp;
+	size_t stride; // in words
+
+	// rows written since the last clear, everything else is clear_color
+	int dirty_top;
+	int dirty_bottom;
+	u32 clear_color;
 
 	int current_y;
 	int current_x;
@@ -91,9 +111,13 @@ struct {
 		.width = 1280,
 		.height = 720,
 		.bpp = 4,
+		.stride = 1280,
+
+		.dirty_top = 0,
+		.dirty_bottom = 720,
 
-		.current_y = 10,
-		.current_x = 10,
+		.current_y = GFX_MARGIN,
+		.current_x = GFX_MARGIN,
 	},
 	[GFX_DRC] =
 	{
@@ -101,14 +125,23 @@ struct {
 		.width = 896,
 		.height = 504,
 		.bpp = 4,
+		.stride = 896,
 
-		.current_y = 10,
-		.current_x = 10,
+		.dirty_top = 0,
+		.dirty_bottom = 504,
+
+		.current_y = GFX_MARGIN,
+		.current_x = GFX_MARGIN,
 	},
 };
 
 static int gfx_currently_headless = 0;
 
+// every 4-pixel half of a glyph row, drawn in gfx_spans_color
+static gfx_span gfx_spans[16];
+static u32 gfx_spans_color;
+static bool gfx_spans_valid = false;
+
 void gfx_init(void)
 {
 	if (!gpu_tv_primary_surface_addr()) {
@@ -133,7 +166,7 @@ size_t gfx_get_stride(gfx_screen_t screen)
 {
 	if(screen == GFX_ALL) return 0;
 
-	return fbs[screen].bpp * fbs[screen].width;
+	return fbs[screen].stride * sizeof(u32);
 }
 
 size_t gfx_get_size(gfx_screen_t screen)
@@ -143,14 +176,80 @@ size_t gfx_get_size(gfx_screen_t screen)
 	return gfx_get_stride(screen) * fbs[screen].height;
 }
 
+static void _gfx_fill(u32* dst, u32 color, size_t count)
+{
+	gfx_burst burst;
+	for(int i = 0; i < GFX_BURST_WORDS; i++)
+		burst.w[i] = color;
+
+	gfx_burst* b = (gfx_burst*)dst;
+	for(; count >= GFX_BURST_WORDS; count -= GFX_BURST_WORDS)
+		*b++ = burst;
+
+	dst = (u32*)b;
+	while(count--)
+		*dst++ = color;
+}
+
+// dst must be below src, so the forward copy never reads what it already wrote
+static void _gfx_copy_down(u32* dst, const u32* src, size_t count)
+{
+	gfx_burst* d = (gfx_burst*)dst;
+	const gfx_burst* s = (const gfx_burst*)src;
+	for(; count >= GFX_BURST_WORDS; count -= GFX_BURST_WORDS)
+		*d++ = *s++;
+
+	dst = (u32*)d;
+	src = (const u32*)s;
+	while(count--)
+		*dst++ = *src++;
+}
+
+static inline void _gfx_mark_dirty(gfx_screen_t screen, int y, int h)
+{
+	if(y < fbs[screen].dirty_top)
+		fbs[screen].dirty_top = y < 0 ? 0 : y;
+	if(y + h > fbs[screen].dirty_bottom)
+		fbs[screen].dirty_bottom = y + h > fbs[screen].height ? fbs[screen].height : y + h;
+}
+
+static void _gfx_build_spans(u32 color)
+{
+	if(gfx_spans_valid && gfx_spans_color == color) return;
+
+	for(int n = 0; n < 16; n++)
+		for(int j = 0; j < CHAR_SIZE_X / 2; j++)
+			gfx_spans[n].w[j] = (n & (8 >> j)) ? color : BLACK;
+
+	gfx_spans_color = color;
+	gfx_spans_valid = true;
+}
+
+// needs _gfx_build_spans for the color first
+static void _gfx_draw_glyph(gfx_screen_t screen, u8 c, int x, int y)
+{
+	const u8* rows = &msx_font[(c - 32) * CHAR_SIZE_Y];
+	size_t stride = fbs[screen].stride;
+	u32* fb = &fbs[screen].ptr[x + y * stride];
+
+	for(int i = 0; i < CHAR_SIZE_Y; i++, fb += stride)
+	{
+		gfx_span* row = (gfx_span*)fb;
+		row[0] = gfx_spans[rows[i] >> 4];
+		row[1] = gfx_spans[rows[i] & 0xF];
+	}
+
+	_gfx_mark_dirty(screen, y, CHAR_SIZE_Y);
+}
+
 void gfx_draw_plot(gfx_screen_t screen, int x, int y, u32 color)
 {
 	if(screen == GFX_ALL) {
 		for(int i = 0; i < GFX_ALL; i++)
 			gfx_draw_plot(i, x, y, color);
 	} else {
-	    u32* fb = &fbs[screen].ptr[x + y * (gfx_get_stride(screen) / sizeof(u32))];
-	    *fb = color;
+	    fbs[screen].ptr[x + y * fbs[screen].stride] = color;
+	    _gfx_mark_dirty(screen, y, 1);
 	}
 }
 
@@ -162,12 +261,52 @@ void gfx_clear(gfx_screen_t screen, u32 color)
 		for(int i = 0; i < GFX_ALL; i++)
 			gfx_clear(i, color);
 	} else {
-	    for(int i = 0; i < fbs[screen].width * fbs[screen].height; i++)
-	        fbs[screen].ptr[i] = color;
+	    // only the rows drawn since the last clear differ, unless the color changes
+	    if(color != fbs[screen].clear_color) {
+	        fbs[screen].dirty_top = 0;
+	        fbs[screen].dirty_bottom = fbs[screen].height;
+	    }
+
+	    int top = fbs[screen].dirty_top;
+	    int bottom = fbs[screen].dirty_bottom;
+	    if(top < bottom)
+	        _gfx_fill(&fbs[screen].ptr[top * fbs[screen].stride], color, (bottom - top) * fbs[screen].stride);
+
+	    fbs[screen].clear_color = color;
+	    fbs[screen].dirty_top = fbs[screen].height;
+	    fbs[screen].dirty_bottom = 0;
+
+	    fbs[screen].current_x = GFX_MARGIN;
+	    fbs[screen].current_y = GFX_MARGIN;
+	}
+}
 
-	    fbs[screen].current_x = 10;
-	    fbs[screen].current_y = 10;
+// moves the picture up by `lines` rows, only touching rows that change
+static void _gfx_scroll(gfx_screen_t screen, int lines)
+{
+	size_t stride = fbs[screen].stride;
+	u32* fb = fbs[screen].ptr;
+	int top = fbs[screen].dirty_top;
+	int bottom = fbs[screen].dirty_bottom;
+
+	if(top < bottom) {
+	    int src = top > lines ? top : lines;
+	    if(src < bottom)
+	        _gfx_copy_down(&fb[(src - lines) * stride], &fb[src * stride], (bottom - src) * stride);
+
+	    // what scrolled out of the dirty rows becomes background
+	    int band = bottom - lines > top ? bottom - lines : top;
+	    _gfx_fill(&fb[band * stride], fbs[screen].clear_color, (bottom - band) * stride);
+
+	    fbs[screen].dirty_top = top > lines ? top - lines : 0;
+	    fbs[screen].dirty_bottom = bottom - lines;
+	    if(fbs[screen].dirty_bottom <= fbs[screen].dirty_top) {
+	        fbs[screen].dirty_top = fbs[screen].height;
+	        fbs[screen].dirty_bottom = 0;
+	    }
 	}
+
+	fbs[screen].current_y -= lines;
 }
 
 void gfx_draw_char(gfx_screen_t screen, char c, int x, int y, u32 color)
@@ -178,25 +317,10 @@ void gfx_draw_char(gfx_screen_t screen, char c, int x, int y, u32 color)
 		for(int i = 0; i < GFX_ALL; i++)
 			gfx_draw_char(i, c, x, y, color);
 	} else {
-		if(c < 32) return;
-		c -= 32;
-
-		const u8* charData = &msx_font[(CHAR_SIZE_X * CHAR_SIZE_Y * c) / 8];
-		u32* fb = &fbs[screen].ptr[x + y * (gfx_get_stride(screen) / sizeof(u32))];
+		if((u8)c < 32) return;
 
-		for(int i = 0; i < CHAR_SIZE_Y; ++i)
-		{
-			u8 v = *(charData++);
-
-			for(int j = 0; j < CHAR_SIZE_X; ++j)
-			{
-				if(v & (128 >> j)) *fb = color;
-				else *fb = 0x00000000;
-				fb++;
-			}
-
-			fb += (gfx_get_stride(screen) / sizeof(u32)) - CHAR_SIZE_X;
-		}
+		_gfx_build_spans(color);
+		_gfx_draw_glyph(screen, c, x, y);
 	}
 }
 
@@ -210,68 +334,82 @@ void gfx_draw_string(gfx_screen_t screen, char* str, int x, int y, u32 color)
 	} else {
 		if(!str) return;
 
+		_gfx_build_spans(color);
+
 		int dx = 0, dy = 0;
 		for(int k = 0; str[k]; k++)
 		{
 			if(str[k] >= 32 && str[k] < 128)
-				gfx_draw_char(screen, str[k], x + dx, y + dy, color);
+				_gfx_draw_glyph(screen, str[k], x + dx, y + dy);
 
-			dx += 8;
+			dx += CHAR_SIZE_X;
 
 			if(str[k] == '\n')
 			{
 				dx = 0;
-				dy -= 8;
+				dy -= CHAR_SIZE_Y;
 			}
 		}
 	}
 }
 
-// This sucks, should use a stdout devoptab.
-int printf(const char* fmt, ...)
+// Text console on each screen. Only the new characters are drawn, and reaching
+// the bottom scrolls the upper half of the text away instead of clearing.
+static void _gfx_console_write(gfx_screen_t screen, const char* str)
 {
-	static char str[0x800];
-	va_list va;
+	int right = fbs[screen].width - GFX_MARGIN - CHAR_SIZE_X;
+	int bottom = fbs[screen].height - GFX_MARGIN * 2;
+	int scroll = ((bottom - GFX_MARGIN) / GFX_LINE_HEIGHT / 2) * GFX_LINE_HEIGHT;
 
-	va_start(va, fmt);
-	vsnprintf(str, sizeof(str), fmt, va);
-	va_end(va);
-
-	char* str_iter = str;
-	while (*str_iter)
+	for(; *str; str++)
 	{
-		if (*str_iter == '\n') {
-			serial_line_inc();
+		u8 c = *str;
+
+		if(c == '\n') {
+			fbs[screen].current_x = GFX_MARGIN;
+			fbs[screen].current_y += GFX_LINE_HEIGHT;
+			continue;
 		}
-		serial_send(*str_iter);
-		str_iter++;
-	}
+		if(c == '\r') {
+			fbs[screen].current_x = GFX_MARGIN;
+			continue;
+		}
+		if(c < 32 || c >= 128)
+			continue;
 
-	int lines = 0;
-	char* last_line = str;
-	for(int k = 0; str[k]; k++)
-	{
-		if(str[k] == '\n')
-		{
-			lines += 10;
-			last_line = &str[k + 1];
+		if(fbs[screen].current_x > right) {
+			fbs[screen].current_x = GFX_MARGIN;
+			fbs[screen].current_y += GFX_LINE_HEIGHT;
 		}
+		// scroll lazily, a trailing newline doesn't move the screen yet
+		while(fbs[screen].current_y + GFX_LINE_HEIGHT > bottom)
+			_gfx_scroll(screen, scroll);
+
+		_gfx_draw_glyph(screen, c, fbs[screen].current_x, fbs[screen].current_y);
+		fbs[screen].current_x += CHAR_SIZE_X;
 	}
+}
 
-	for(int i = 0; i < GFX_ALL; i++) {
-		if(fbs[i].current_y + lines >= fbs[i].height - 20)
-			gfx_clear(i, BLACK);
+void gfx_console_write(const char* str)
+{
+	if (gfx_currently_headless) return;
 
-		gfx_draw_string(i, str, fbs[i].current_x, fbs[i].current_y, WHITE);
-		if (!lines) {
-			fbs[i].current_x += ((strlen(last_line)-1) * CHAR_WIDTH);
-		}
-		else {
-			fbs[i].current_x = 10;
-		}
+	_gfx_build_spans(WHITE);
+	for(int i = 0; i < GFX_ALL; i++)
+		_gfx_console_write(i, str);
+}
 
-		fbs[i].current_y += lines;
-	}
+// This sucks, should use a stdout devoptab.
+int printf(const char* fmt, ...)
+{
+	static char str[0x800];
+	va_list va;
+
+	va_start(va, fmt);
+	vsnprintf(str, sizeof(str), fmt, va);
+	va_end(va);
+
+	log_puts(LOG_INFO, str);
 
     return 0;
 }
@@ -285,6 +423,9 @@ int serial_printf(const char* fmt, ...)
 	vsnprintf(str, sizeof(str), fmt, va);
 	va_end(va);
 
+	// keep the order with what is still queued
+	log_flush();
+
 	char* str_iter = str;
 	while (*str_iter)
 	{
@@ -29,6 +29,11 @@ void hmac_update(hmac_ctx* ctx, const void* data, int size)
     sha_update(&ctx->hash_ctx, data, size);
 }
 
+void hmac_update_async(hmac_ctx* ctx, const void* data, int size)
+{
+    sha_update_async(&ctx->hash_ctx, data, size);
+}
+
 void hmac_final(hmac_ctx* ctx, u8* hmac)
 {
     u8 hash[SHA_HASH_SIZE];
@@ -13,6 +13,7 @@ typedef struct {
 
 void hmac_init(hmac_ctx* ctx, const u8* key, int size);
 void hmac_update(hmac_ctx* ctx, const void* data, int size);
+void hmac_update_async(hmac_ctx* ctx, const void* data, int size); // finish with sha_wait() or hmac_final()
 void hmac_final(hmac_ctx *ctx, u8 *hmac); 
 
 #endif /* _HMAC_H */
@@ -26,6 +26,9 @@
 #include "sha.h"
 #include "asic.h"
 #include "ppc.h"
+#include "nand.h"
+#include "isfs.h"
+#include "fatfs/diskio.h"
 
 #define INTCON_HISTORY_DEPTH (64)
 #define INTCON_COMMAND_MAX_LEN (256)
@@ -103,7 +106,7 @@ void intcon_delete()
 
 void intcon_show_help(void)
 {
-    printf("Valid commands: exit, quit, reset, restart, shutdown, smc, peek, poke, set, clear, help, ?\n");
+    printf("Valid commands: exit, quit, reset, restart, shutdown, smc, peek, poke, set, clear, ecctest, shatest, diskstats, isfsstats, help, ?\n");
 }
 
 void intcon_smc_cmd(int argc, char** argv)
@@ -714,6 +717,19 @@ void intcon_handle_cmd(const char* pCmd)
             ppc_test(strtoll(argv[1], NULL, 0));
         }
     }
+    else if (!strcmp(cmd, "ecctest")) {
+        nand_ecc_test(argc < 2 ? 256 : strtoll(argv[1], NULL, 0));
+    }
+    else if (!strcmp(cmd, "shatest")) {
+        sha_benchmark(argc < 2 ? 0x100000 : strtoll(argv[1], NULL, 0));
+    }
+    else if (!strcmp(cmd, "diskstats")) {
+        disk_print_stats();
+    }
+    else if (!strcmp(cmd, "isfsstats")) {
+        for (int i = ISFSVOL_SLC; i <= ISFSVOL_REDSLCCMPT; i++)
+            isfs_print_cache_stats(i);
+    }
     else if (!strcmp(cmd, "help") || !strcmp(cmd, "?")) {
         intcon_show_help();
     }
@@ -17,10 +17,12 @@
 #include "gfx.h"
 #include "utils.h"
 #include "crypto.h"
+#include "sha.h"
 #include "nand.h"
 #include "sdcard.h"
 #include "mlc.h"
 #include "serial.h"
+#include "log.h"
 
 static u32 _alarm_frequency = 0;
 
@@ -74,6 +76,7 @@ void irq_handler(void)
             write32(LT_ALARM, read32(LT_TIMER) + _alarm_frequency);
 
         write32(LT_INTSR_AHBALL_ARM, IRQF_TIMER);
+        log_irq();
     }
 
     if(all_mask & IRQF_NAND) {
@@ -98,12 +101,15 @@ void irq_handler(void)
         write32(LT_INTSR_AHBALL_ARM, IRQF_RESET);
     }*/
     if(all_mask & IRQF_SHA1) {
-        printf("IRQ: SHA1\n");
+//      printf("IRQ: SHA1\n");
+        // ack first, the handler may start the next command
         write32(LT_INTSR_AHBALL_ARM, IRQF_SHA1);
+        sha_irq();
     }
     if(all_mask & IRQF_AES) {
 //      printf("IRQ: AES\n");
         write32(LT_INTSR_AHBALL_ARM, IRQF_AES);
+        aes_irq();
     }
     if(all_mask & IRQF_SD0) {
 //      printf("IRQ: SD0\n");
@@ -167,3 +173,25 @@ void irq_wait(void)
     u32 data = 0;
     __asm__ volatile ( "mcr p15, 0, %0, c7, c0, 4" : : "r" (data) );
 }
+
+// irq_wait, but also woken by LT_ALARM after at most `ticks`, whether or not
+// anyone else is using the timer
+void irq_wait_ticks(u32 ticks)
+{
+    u32 now = read32(LT_TIMER);
+    u32 pending = read32(LT_ALARM) - now;
+    bool enabled = read32(LT_INTMR_AHBALL_ARM) & IRQF_TIMER;
+
+    // a sooner periodic alarm is left alone, a later one is re-armed by the handler
+    if(!enabled || (s32)pending <= 0 || pending > ticks)
+        write32(LT_ALARM, now + ticks);
+    if(!enabled)
+        set32(LT_INTMR_AHBALL_ARM, IRQF_TIMER);
+
+    irq_wait();
+
+    if(!enabled) {
+        clear32(LT_INTMR_AHBALL_ARM, IRQF_TIMER);
+        write32(LT_INTSR_AHBALL_ARM, IRQF_TIMER);
+    }
+}
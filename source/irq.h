@@ -73,5 +73,6 @@ u32 irq_kill(void);
 void irq_restore(u32 cookie);
 
 void irq_wait(void);
+void irq_wait_ticks(u32 ticks);
 
 void irq_set_alarm(u32 ms, u8 enable);
@@ -28,6 +28,7 @@
 #include "rednand.h"
 
 #include "isfshax.h"
+#include "trace.h"
 
 // #define ISFS_DEBUG
 
@@ -39,6 +40,7 @@
 
 static u8 slc_cluster_buf[CLUSTER_SIZE] ALIGNED(NAND_DATA_ALIGN);
 static u8 ecc_buf[ECC_BUFFER_ALLOC] ALIGNED(NAND_DATA_ALIGN);
+static u8 ecc_buf_next[ECC_BUFFER_ALLOC] ALIGNED(NAND_DATA_ALIGN);
 
 static bool initialized = false;
 
@@ -108,11 +110,26 @@ static int _isfs_super_check_slot(isfs_ctx *ctx, u32 index)
     return 0;
 }
 
-static int _isfs_decrypt_cluster(const isfs_ctx* ctx, u8 *cluster_data){
+// every cluster is its own CBC chain starting from a zero IV
+static const u8 isfs_zero_iv[ISFSAES_BLOCK_SIZE] = {0};
+
+static void _isfs_decrypt_setup(const isfs_ctx* ctx){
     aes_reset();
     aes_set_key((u8*)ctx->aes);
-    aes_empty_iv();
-    aes_decrypt(cluster_data, cluster_data, CLUSTER_SIZE / ISFSAES_BLOCK_SIZE, 0);  
+}
+
+// queues the clusters, aes_wait() before touching them
+static void _isfs_decrypt_clusters_async(u8 *cluster_data, u32 cluster_count){
+    for (u32 i = 0; i < cluster_count; i++) {
+        u8 *cluster = cluster_data + i * CLUSTER_SIZE;
+        aes_decrypt_async(cluster, cluster, CLUSTER_SIZE / ISFSAES_BLOCK_SIZE, 0, isfs_zero_iv);
+    }
+}
+
+static void _isfs_decrypt_clusters(const isfs_ctx* ctx, u8 *cluster_data, u32 cluster_count){
+    _isfs_decrypt_setup(ctx);
+    _isfs_decrypt_clusters_async(cluster_data, cluster_count);
+    aes_wait();
 }
 
 static int _isfs_read_sd(const isfs_ctx* ctx, u32 start_cluster, u32 cluster_count, u32 flags, void *data){
@@ -126,23 +143,44 @@ static int _isfs_read_sd(const isfs_ctx* ctx, u32 start_cluster, u32 cluster_cou
     if(!redpart.lba_length)
         return -1;
 
-    if(sdcard_read(redpart.lba_start + make_sector(start_cluster), make_sector(cluster_count), data))
-        return -1;
+    if(!(flags & ISFSVOL_FLAG_ENCRYPTED))
+        return sdcard_read(redpart.lba_start + make_sector(start_cluster), make_sector(cluster_count), data) ? -1 : 0;
 
-    if(flags & ISFSVOL_FLAG_ENCRYPTED){
-        for (int p = 0; p < cluster_count; p++){
-            _isfs_decrypt_cluster(ctx, data + p * CLUSTER_SIZE);
+    /* decrypt each batch while the next one is read */
+    int res = 0;
+    _isfs_decrypt_setup(ctx);
+    for(u32 done = 0; done < cluster_count; ) {
+        u32 count = min(cluster_count - done, ISFS_SD_READ_CLUSTERS);
+        u8 *batch = (u8*)data + done * CLUSTER_SIZE;
+        if(sdcard_read(redpart.lba_start + make_sector(start_cluster + done), make_sector(count), batch)) {
+            res = -1;
+            break;
         }
+        _isfs_decrypt_clusters_async(batch, count);
+        done += count;
     }
-    return 0;
+    aes_wait();
+
+    return res;
 }
 
-static int _nand_read_page_rawfile(u32 pageno, void *data, void *ecc, FIL* file){
+static int _nand_read_page_rawfile(const isfs_ctx* ctx, u32 pageno, void *data, void *ecc){
 #ifdef MINUTE_BOOT1
     return -128;
 #else
     //ISFS_debug("ISFS: reading from file\n");
-    u32 off = pageno * (PAGE_SIZE + PAGE_SPARE_SIZE);
+    FIL* file = ctx->file;
+    u32 off = pageno * NAND_RAW_PAGE_STRIDE;
+    if(ctx->file_blocks){
+        u32 block = pageno / BLOCK_PAGES;
+        u16 slot = block < NAND_SPARSE_BLOCKS ? ctx->file_blocks[block] : NAND_SPARSE_ERASED;
+        if(slot == NAND_SPARSE_ERASED){
+            memset(data, 0xFF, PAGE_SIZE);
+            memset(ecc, 0xFF, PAGE_SPARE_SIZE);
+            return 0;
+        }
+        off = NAND_SPARSE_HDR_SIZE + slot * NAND_RAW_BLOCK_SIZE + (pageno % BLOCK_PAGES) * NAND_RAW_PAGE_STRIDE;
+    }
     if(f_lseek(file, off) != FR_OK){
         ISFS_debug("ISFS: Error seeking file\n");
         return -1;
@@ -160,6 +198,46 @@ static int _nand_read_page_rawfile(u32 pageno, void *data, void *ecc, FIL* file)
 #endif //MINUTE_BOOT1
 }
 
+/* clusters move read -> decrypted (AES) -> hashed (SHA), both engines run in the background */
+typedef struct {
+    u8* data;
+    u32 flags;
+    hmac_ctx* hmac;
+    u32 read;
+    u32 aes_next;
+    u32 sha_next;
+} isfs_crypto_pipe;
+
+static void _isfs_crypto_step(isfs_crypto_pipe* pipe)
+{
+    bool encrypted = pipe->flags & ISFSVOL_FLAG_ENCRYPTED;
+    bool aes_idle = !encrypted || aes_poll();
+    u32 decrypted = !encrypted ? pipe->read : pipe->aes_next - (aes_idle ? 0 : 1);
+
+    if((pipe->flags & ISFSVOL_FLAG_HMAC) && pipe->sha_next < decrypted && sha_poll()) {
+        hmac_update_async(pipe->hmac, pipe->data + pipe->sha_next * CLUSTER_SIZE, CLUSTER_SIZE);
+        pipe->sha_next++;
+    }
+
+    if(encrypted && aes_idle && pipe->aes_next < pipe->read) {
+        u8 *cluster_data = pipe->data + pipe->aes_next * CLUSTER_SIZE;
+        aes_decrypt_async(cluster_data, cluster_data, CLUSTER_SIZE / ISFSAES_BLOCK_SIZE, 0, isfs_zero_iv);
+        pipe->aes_next++;
+    }
+}
+
+static void _isfs_crypto_drain(isfs_crypto_pipe* pipe)
+{
+    for(;;) {
+        _isfs_crypto_step(pipe);
+        if((pipe->flags & ISFSVOL_FLAG_ENCRYPTED) && (pipe->aes_next < pipe->read || !aes_poll()))
+            continue;
+        if((pipe->flags & ISFSVOL_FLAG_HMAC) && (pipe->sha_next < pipe->read || !sha_poll()))
+            continue;
+        break;
+    }
+}
+
 int isfs_read_volume(const isfs_ctx* ctx, u32 start_cluster, u32 cluster_count, u32 flags, void *hmac_seed, void *data)
 {
     if(ctx->bank & 0x80000000) {
@@ -167,7 +245,10 @@ int isfs_read_volume(const isfs_ctx* ctx, u32 start_cluster, u32 cluster_count,
     }
 
     u8 saved_hmacs[2][20] = {0}, hmac[20] = {0};
-    u32 i, p;
+    u8 *ecc_bufs[2] = { ecc_buf, ecc_buf_next };
+    u32 first_page = start_cluster * CLUSTER_PAGES;
+    u32 page_count = cluster_count * CLUSTER_PAGES;
+    u32 n, p;
 
     /* enable slc or slccmpt bank */
     if(!ctx->file)
@@ -179,61 +260,81 @@ int isfs_read_volume(const isfs_ctx* ctx, u32 start_cluster, u32 cluster_count,
     bool hmac_partial = false;
     bool nand_error = false;
 
-    /* read all requested clusters */
-    for (i = 0; i < cluster_count; i++)
-    {
-        u32 cluster = start_cluster + i;
-        u8 *cluster_data = (u8 *)data + i * CLUSTER_SIZE;
-        u32 cluster_start = cluster * CLUSTER_PAGES;
+    /* decrypt and hash finished clusters while the following pages are read */
+    hmac_ctx calc_hmac;
+    isfs_crypto_pipe pipe = { .data = data, .flags = flags, .hmac = &calc_hmac };
+    if (flags & ISFSVOL_FLAG_ENCRYPTED)
+        _isfs_decrypt_setup(ctx);
+    if (flags & ISFSVOL_FLAG_HMAC) {
+        hmac_init(&calc_hmac, ctx->hmac, 20);
+        hmac_update(&calc_hmac, (const u8 *)hmac_seed, SHA_BLOCK_SIZE);
+    }
 
-        /* read cluster pages */
-        for (p = 0; p < CLUSTER_PAGES; p++)
-        {
-            // make sure ECC fails, if read did nothing
-            memset(ecc_buf, 0, ECC_BUFFER_ALLOC);
-            /* attempt to read the page (and correct ecc errors) */
-            int nand_error;
-            if(ctx->file){
-                nand_error = _nand_read_page_rawfile(cluster_start + p, &cluster_data[p * PAGE_SIZE], ecc_buf, ctx->file);
-            } else {
-                nand_error = nand_read_page(cluster_start + p, &cluster_data[p * PAGE_SIZE], ecc_buf);
-                int correct = nand_correct(cluster_start + p, &cluster_data[p * PAGE_SIZE], ecc_buf);
-                /* uncorrectable ecc error or other issues */
-                if (correct < 0) {
-                    ISFS_debug("Uncorrectable ECC ERROR\n");
-                    ecc_uncorrectable = true;
-                }
+    /* keep the next page transferring while the current one is corrected */
+    if(!ctx->file && page_count) {
+        // make sure ECC fails, if read did nothing
+        memset(ecc_bufs[0], 0, ECC_BUFFER_ALLOC);
+        nand_start_read_page(first_page, data, ecc_bufs[0]);
+    }
 
-                /* ECC errors, a refresh might be needed */
-                if (correct > 0){
-                    ISFS_debug("Corrected ECC ERROR\n");
-                    ecc_correctable = true;
-                }
+    /* read all requested pages */
+    for (n = 0; n < page_count; n++)
+    {
+        u8 *page_data = (u8 *)data + n * PAGE_SIZE;
+        u8 *ecc = ecc_bufs[n & 1];
+        int error;
+        p = n % CLUSTER_PAGES;
+
+        /* attempt to read the page (and correct ecc errors) */
+        if(ctx->file){
+            memset(ecc, 0, ECC_BUFFER_ALLOC);
+            error = _nand_read_page_rawfile(ctx, first_page + n, page_data, ecc);
+        } else {
+            error = nand_end_read_page();
+            if(n + 1 < page_count) {
+                memset(ecc_bufs[(n + 1) & 1], 0, ECC_BUFFER_ALLOC);
+                nand_start_read_page(first_page + n + 1, page_data + PAGE_SIZE, ecc_bufs[(n + 1) & 1]);
             }
-                
-            if(nand_error){
-                ISFS_debug("NAND ERROR on read\n");
-                nand_error = true;
+
+            int correct = nand_correct(first_page + n, page_data, ecc);
+            /* uncorrectable ecc error or other issues */
+            if (correct < 0) {
+                ISFS_debug("Uncorrectable ECC ERROR\n");
+                ecc_uncorrectable = true;
             }
 
-            /* page 6 and 7 store the hmac */
-            if (p == 6)
-            {
-                memcpy(saved_hmacs[0], &ecc_buf[1], 20);
-                memcpy(saved_hmacs[1], &ecc_buf[21], 12);
+            /* ECC errors, a refresh might be needed */
+            if (correct > 0){
+                ISFS_debug("Corrected ECC ERROR\n");
+                ecc_correctable = true;
             }
-            if (p == 7)
-                memcpy(&saved_hmacs[1][12], &ecc_buf[1], 8);
         }
 
-        /* decrypt cluster */
-        if (flags & ISFSVOL_FLAG_ENCRYPTED)
-            _isfs_decrypt_cluster(ctx, cluster_data);
+        if(error){
+            ISFS_debug("NAND ERROR on read\n");
+            nand_error = true;
+        }
 
+        /* page 6 and 7 store the hmac */
+        if (p == 6)
+        {
+            memcpy(saved_hmacs[0], &ecc[1], 20);
+            memcpy(saved_hmacs[1], &ecc[21], 12);
+        }
+        if (p == 7)
+            memcpy(&saved_hmacs[1][12], &ecc[1], 8);
+
+        if (p == CLUSTER_PAGES - 1)
+            pipe.read++;
+        _isfs_crypto_step(&pipe);
     }
 
+    _isfs_crypto_drain(&pipe);
+
+    /* a failed page read is an error of its own now, the baseline shadowed
+       nand_error inside the loop and quietly went on with whatever was read */
     if(nand_error)
-        return ISFSVOL_ERROR_READ; 
+        return ISFSVOL_ERROR_READ;
 
     if(ecc_uncorrectable)
         return ISFSVOL_ERROR_ECC;
@@ -241,13 +342,8 @@ int isfs_read_volume(const isfs_ctx* ctx, u32 start_cluster, u32 cluster_count,
     /* verify hmac */
     if (flags & ISFSVOL_FLAG_HMAC)
     {
-        hmac_ctx calc_hmac;
         int matched = 0;
 
-        /* compute clusters hmac */
-        hmac_init(&calc_hmac, ctx->hmac, 20);
-        hmac_update(&calc_hmac, (const u8 *)hmac_seed, SHA_BLOCK_SIZE);
-        hmac_update(&calc_hmac, (const u8 *)data, cluster_count * CLUSTER_SIZE);
         hmac_final(&calc_hmac, hmac);
 
         /* ensure at least one of the saved hmacs matches */
@@ -272,6 +368,158 @@ int isfs_read_volume(const isfs_ctx* ctx, u32 start_cluster, u32 cluster_count,
     return rc;
 }
 
+static int _isfs_cache_init(isfs_ctx* ctx)
+{
+    isfs_cache* cache = ctx->cache;
+    if(!cache) {
+        cache = calloc(1, sizeof(isfs_cache));
+        if(!cache) return -1;
+        cache->data = memalign(NAND_DATA_ALIGN, ISFS_CACHE_CLUSTERS * CLUSTER_SIZE);
+        if(!cache->data) {
+            free(cache);
+            return -1;
+        }
+        ctx->cache = cache;
+    }
+
+    for(int i = 0; i < ISFS_CACHE_CLUSTERS; i++) {
+        cache->cluster[i] = ISFS_CACHE_EMPTY;
+        cache->used[i] = 0;
+    }
+    cache->tick = 0;
+    cache->last = ISFS_CACHE_EMPTY;
+    cache->hits = cache->misses = cache->readahead = 0;
+
+    return 0;
+}
+
+static void _isfs_cache_free(isfs_ctx* ctx)
+{
+    if(!ctx->cache) return;
+
+    free(ctx->cache->data);
+    free(ctx->cache);
+    ctx->cache = NULL;
+}
+
+void isfs_cache_invalidate(const isfs_ctx* ctx, u32 start_cluster, u32 cluster_count)
+{
+    isfs_cache* cache = ctx->cache;
+    if(!cache) return;
+
+    for(int i = 0; i < ISFS_CACHE_CLUSTERS; i++) {
+        u16 cluster = cache->cluster[i];
+        if(cluster != ISFS_CACHE_EMPTY && cluster >= start_cluster && cluster < start_cluster + cluster_count)
+            cache->cluster[i] = ISFS_CACHE_EMPTY;
+    }
+    cache->last = ISFS_CACHE_EMPTY;
+}
+
+static int _isfs_cache_lookup(isfs_cache* cache, u16 cluster)
+{
+    for(int i = 0; i < ISFS_CACHE_CLUSTERS; i++)
+        if(cache->cluster[i] == cluster)
+            return i;
+
+    return -1;
+}
+
+// reads count physically consecutive clusters into the oldest run of adjacent slots
+static int _isfs_cache_fill(const isfs_ctx* ctx, u16 cluster, u32 count)
+{
+    isfs_cache* cache = ctx->cache;
+    int slot = -1;
+    u32 best = 0;
+
+    for(int s = 0; s + count <= ISFS_CACHE_CLUSTERS; s++) {
+        u32 newest = 0;
+        for(int i = s; i < s + count; i++)
+            if(cache->cluster[i] != ISFS_CACHE_EMPTY && cache->used[i] > newest)
+                newest = cache->used[i];
+        if(slot < 0 || newest < best) {
+            slot = s;
+            best = newest;
+        }
+    }
+
+    for(u32 i = 0; i < count; i++)
+        cache->cluster[slot + i] = ISFS_CACHE_EMPTY;
+
+    if(isfs_read_volume(ctx, cluster, count, ISFSVOL_FLAG_ENCRYPTED, NULL, cache->data + slot * CLUSTER_SIZE) < 0)
+        return -1;
+
+    for(u32 i = 0; i < count; i++) {
+        cache->cluster[slot + i] = cluster + i;
+        cache->used[slot + i] = ++cache->tick;
+    }
+    return slot;
+}
+
+_Static_assert(ISFS_CACHE_READAHEAD < ISFS_CACHE_CLUSTERS, "read-ahead must leave room for the requested cluster");
+
+// returns the decrypted contents of a file cluster, or NULL on error
+static u8* _isfs_cache_get(isfs_ctx* ctx, u16 cluster)
+{
+    if(cluster >= CLUSTER_COUNT)
+        return NULL;
+
+    isfs_cache* cache = ctx->cache;
+    if(!cache) {
+        if(isfs_read_volume(ctx, cluster, 1, ISFSVOL_FLAG_ENCRYPTED, NULL, slc_cluster_buf) < 0)
+            return NULL;
+        return slc_cluster_buf;
+    }
+
+    u16* fat = _isfs_get_fat(ctx);
+    bool sequential = cache->last != ISFS_CACHE_EMPTY && fat[cache->last] == cluster;
+    cache->last = cluster;
+
+    int slot = _isfs_cache_lookup(cache, cluster);
+    if(slot >= 0) {
+        cache->hits++;
+        cache->used[slot] = ++cache->tick;
+        return cache->data + slot * CLUSTER_SIZE;
+    }
+
+    cache->misses++;
+
+    /* read ahead the physically contiguous part of the chain in the same request */
+    u32 count = 1;
+    if(sequential)
+        while(count <= ISFS_CACHE_READAHEAD && fat[cluster + count - 1] == cluster + count &&
+              _isfs_cache_lookup(cache, cluster + count) < 0)
+            count++;
+
+    slot = _isfs_cache_fill(ctx, cluster, count);
+    if(slot < 0)
+        return NULL;
+    cache->readahead += count - 1;
+
+    /* the chain jumps elsewhere, keep following it for the rest of the window */
+    if(sequential) {
+        u16 next = fat[cluster + count - 1];
+        for(u32 i = count - 1; i < ISFS_CACHE_READAHEAD && next < CLUSTER_COUNT; i++, next = fat[next]) {
+            if(_isfs_cache_lookup(cache, next) >= 0)
+                continue;
+            if(_isfs_cache_fill(ctx, next, 1) < 0)
+                break;
+            cache->readahead++;
+        }
+    }
+
+    return cache->data + slot * CLUSTER_SIZE;
+}
+
+void isfs_print_cache_stats(int volume)
+{
+    isfs_ctx* ctx = isfs_get_volume(volume);
+    if(!ctx || !ctx->cache) return;
+
+    isfs_cache* cache = ctx->cache;
+    printf("ISFS: %s cache: %lu hits, %lu misses, %lu clusters read ahead\n",
+            ctx->name, cache->hits, cache->misses, cache->readahead);
+}
+
 #ifdef NAND_WRITE_ENABLED
 static int _isfs_write_sd(const isfs_ctx* ctx, u32 start_cluster, u32 cluster_count, u32 flags, void *data){
     inline u32 make_sector(u32 page) {
@@ -287,22 +535,23 @@ static int _isfs_write_sd(const isfs_ctx* ctx, u32 start_cluster, u32 cluster_co
     if(sdcard_write(redpart.lba_start + make_sector(start_cluster), make_sector(cluster_count), data))
         return -1;
 
-    if(flags & ISFSVOL_FLAG_ENCRYPTED){
-        for (int p = 0; p < cluster_count; p++){
-            _isfs_decrypt_cluster(ctx, data + p * CLUSTER_SIZE);
-        }
-    }
+    if(flags & ISFSVOL_FLAG_ENCRYPTED)
+        _isfs_decrypt_clusters(ctx, data, cluster_count);
+
     return 0;
 }
 
 int isfs_write_volume(const isfs_ctx* ctx, u32 start_cluster, u32 cluster_count, u32 flags, void *hmac_seed, void *data)
 {
+    isfs_cache_invalidate(ctx, start_cluster, cluster_count);
+
     if(ctx->bank & 0x80000000) {
         return _isfs_write_sd(ctx, start_cluster, cluster_count, flags, data);
     }
 
     static u8 blockpg[BLOCK_PAGES][PAGE_SIZE] ALIGNED(NAND_DATA_ALIGN), blocksp[BLOCK_PAGES][PAGE_SPARE_SIZE];
     static u8 pgbuf[PAGE_SIZE] ALIGNED(NAND_DATA_ALIGN);
+    u32 pg_ticket[BLOCK_PAGES] = {0};
     u8 hmac[20] = {0};
     u32 b, p;
 
@@ -351,8 +600,10 @@ int isfs_write_volume(const isfs_ctx* ctx, u32 start_cluster, u32 cluster_count,
             {
                 ISFS_debug("Reading existing page\n");
                 nand_read_page(curpage, blockpg[p], ecc_buf);
-                if (nand_correct(curpage, blockpg[p], ecc_buf) < 0)
+                if (nand_correct(curpage, blockpg[p], ecc_buf) < 0) {
+                    aes_wait();
                     return ISFSVOL_ERROR_READ;
+                }
                 memcpy(blocksp[p], ecc_buf, PAGE_SPARE_SIZE);
                 continue;
             }
@@ -370,26 +621,31 @@ int isfs_write_volume(const isfs_ctx* ctx, u32 start_cluster, u32 cluster_count,
                 break;
             }
 
-            /* encrypt or copy the data */
+            /* encrypt (queued, runs during the erase and earlier page writes) or copy the data */
             u8 *srcdata = (u8*)data + (curpage - startpage) * PAGE_SIZE;
             if (flags & ISFSVOL_FLAG_ENCRYPTED)
-                aes_encrypt(blockpg[p], srcdata, PAGE_SIZE / ISFSAES_BLOCK_SIZE, clusidx > 0);
+                pg_ticket[p] = aes_encrypt_async(blockpg[p], srcdata, PAGE_SIZE / ISFSAES_BLOCK_SIZE, clusidx > 0, NULL);
             else
                 memcpy(blockpg[p], srcdata, PAGE_SIZE);
         }
         ISFS_debug("Erase block\n");
         /* erase block */
-        if (nand_erase_block(b * BLOCK_PAGES) < 0)
+        if (nand_erase_block(b * BLOCK_PAGES) < 0) {
+            aes_wait();
             return ISFSVOL_ERROR_ERASE;
+        }
 
         int write_error = 0;
         ISFS_debug("Writing\n");
         /* write block */
-        for (p = 0; p < BLOCK_PAGES; p++)
+        for (p = 0; p < BLOCK_PAGES; p++) {
+            if (flags & ISFSVOL_FLAG_ENCRYPTED)
+                aes_wait_ticket(pg_ticket[p]);
             if (nand_write_page(firstblockpage + p, blockpg[p], blocksp[p]) < 0){
                 printf("ISFS: Error writing page\n");
                 write_error = ISFSVOL_ERROR_WRITE;
             }
+        }
         if(write_error)
             return write_error;
 
@@ -524,7 +780,118 @@ static bool _isfs_fst_is_dir(const isfs_fst* fst)
     return _isfs_fst_get_type(fst) == 2;
 }
 
+static u32 _isfs_lookup_hash(u16 parent, const char* name, size_t len)
+{
+    u32 hash = 2166136261u ^ parent;
+    for(size_t i = 0; i < len; i++)
+        hash = (hash ^ (u8)name[i]) * 16777619u;
+    return hash & (ISFS_LOOKUP_SLOTS - 1);
+}
+
+static int _isfs_lookup_insert(isfs_ctx* ctx, u16 parent, u16 index)
+{
+    isfs_fst* fst = &_isfs_get_fst(ctx)[index];
+    u32 slot = _isfs_lookup_hash(parent, fst->name, strnlen(fst->name, sizeof(fst->name)));
+
+    for(u32 i = 0; i < ISFS_LOOKUP_SLOTS; i++, slot = (slot + 1) & (ISFS_LOOKUP_SLOTS - 1)) {
+        if(ctx->lookup[slot].fst != 0xFFFF) continue;
+        ctx->lookup[slot].parent = parent;
+        ctx->lookup[slot].fst = index;
+        return 0;
+    }
+    return -1;
+}
+
+static int _isfs_lookup_add_dir(isfs_ctx* ctx, u16 dir, int depth)
+{
+    isfs_fst* root = _isfs_get_fst(ctx);
+    u32 entries = 0;
+
+    if(depth > ISFS_LOOKUP_MAX_DEPTH)
+        return -1;
+
+    for(u16 child = root[dir].sub; child != 0xFFFF; child = root[child].sib) {
+        if(child >= ISFS_FST_COUNT || ++entries > ISFS_FST_COUNT)
+            return -1;
+        if(_isfs_lookup_insert(ctx, dir, child))
+            return -1;
+        if(_isfs_fst_is_dir(&root[child]) && _isfs_lookup_add_dir(ctx, child, depth + 1))
+            return -1;
+    }
+    return 0;
+}
+
+static void _isfs_lookup_free(isfs_ctx* ctx)
+{
+    if(!ctx->lookup) return;
+
+    free(ctx->lookup);
+    ctx->lookup = NULL;
+}
+
+// (re)index the in-memory FST, on failure lookups fall back to walking it
+static int _isfs_lookup_build(isfs_ctx* ctx)
+{
+    if(!ctx->lookup)
+        ctx->lookup = malloc(ISFS_LOOKUP_SLOTS * sizeof(isfs_lookup_slot));
+    if(!ctx->lookup)
+        return -1;
+
+    memset(ctx->lookup, 0xFF, ISFS_LOOKUP_SLOTS * sizeof(isfs_lookup_slot));
+
+    if(_isfs_lookup_add_dir(ctx, 0, 0)) {
+        ISFS_debug("FST of %s can't be indexed\n", ctx->name);
+        _isfs_lookup_free(ctx);
+        return -1;
+    }
+    return 0;
+}
+
+static isfs_fst* _isfs_lookup_path(isfs_ctx* ctx, const char* path)
+{
+    isfs_fst* root = _isfs_get_fst(ctx);
+    u16 dir = 0;
+
+    while(true) {
+        while(*path == '/') path++;
+        const char* remaining = strchr(path, '/');
+        size_t size = remaining ? remaining - path : strlen(path);
+        if(!size || size > sizeof(root->name))
+            return NULL;
+
+        u32 slot = _isfs_lookup_hash(dir, path, size);
+        isfs_fst* fst = NULL;
+        for(u32 i = 0; i < ISFS_LOOKUP_SLOTS; i++, slot = (slot + 1) & (ISFS_LOOKUP_SLOTS - 1)) {
+            isfs_lookup_slot* entry = &ctx->lookup[slot];
+            if(entry->fst == 0xFFFF)
+                return NULL;
+            if(entry->parent != dir)
+                continue;
+
+            isfs_fst* candidate = &root[entry->fst];
+            if((size < sizeof(candidate->name) && candidate->name[size]) || memcmp(path, candidate->name, size))
+                continue;
+
+            fst = candidate;
+            dir = entry->fst;
+            break;
+        }
+        if(!fst)
+            return NULL;
+
+        if(!remaining)
+            return fst;
+        if(_isfs_fst_is_file(fst))
+            return NULL;
+        path = remaining;
+    }
+}
+
 static isfs_fst* _isfs_find_fst(isfs_ctx* ctx, const char* path, void** parent){
+    // the hash table doesn't know which link points at the entry
+    if(!parent && ctx->lookup)
+        return _isfs_lookup_path(ctx, path);
+
     isfs_fst* root = _isfs_get_fst(ctx);
     if(parent)
         *parent = &root->sub;
@@ -602,7 +969,55 @@ int isfs_write_super(isfs_ctx *ctx, void *super, int index)
 }
 #endif
 
+_Static_assert(ISFS_SUPER_SLOTS_MAX >= 64, "superblock table too small");
+
+// only the magic and generation are needed, so read just the first page (or sector) of the slot
+static int _isfs_read_super_header(const isfs_ctx* ctx, u32 cluster, void *buffer)
+{
+    u32 page = cluster * CLUSTER_PAGES;
+
+    if(ctx->bank & 0x80000000) {
+        rednand_partition redpart = (ctx->bank & 0xFF)?rednand.slccmpt:rednand.slc;
+        if(!redpart.lba_length)
+            return -1;
+        return sdcard_read(redpart.lba_start + (cluster * CLUSTER_SIZE) / SDMMC_DEFAULT_BLOCKLEN, 1, buffer);
+    }
+
+    // make sure ECC fails, if read did nothing
+    memset(ecc_buf, 0, ECC_BUFFER_ALLOC);
+    if(ctx->file)
+        return _nand_read_page_rawfile(ctx, page, buffer, ecc_buf);
+
+    if(nand_read_page(page, buffer, ecc_buf) < 0)
+        return -1;
+    if(nand_correct(page, buffer, ecc_buf) < 0)
+        return -1;
+    return 0;
+}
+
 //not thread safe because of static buffer
+static void _isfs_scan_supers(isfs_ctx* ctx)
+{
+    if(!ctx->file && !(ctx->bank & 0x80000000))
+        nand_initialize(ctx->bank);
+
+    for(int i = 0; i < ctx->super_count; i++)
+    {
+        u32 cluster = CLUSTER_COUNT - (ctx->super_count - i) * ISFSSUPER_CLUSTERS;
+        isfs_super_slot *slot = &ctx->supers[i];
+
+        slot->version = -1;
+        if(_isfs_read_super_header(ctx, cluster, slc_cluster_buf))
+            continue;
+
+        slot->version = _isfs_get_super_version(slc_cluster_buf);
+        slot->generation = _isfs_get_super_generation(slc_cluster_buf);
+    }
+
+    ctx->supers_valid = true;
+    ctx->supers_stamp = nand_get_program_count();
+}
+
 int isfs_find_super(isfs_ctx* ctx, u32 min_generation, u32 max_generation, u32 *generation, u32 *version)
 {
     struct {
@@ -611,17 +1026,15 @@ int isfs_find_super(isfs_ctx* ctx, u32 min_generation, u32 max_generation, u32 *
         u8 version;
     } newest = {-1, 0, 0};
 
+    if(!ctx->supers_valid)
+        _isfs_scan_supers(ctx);
+
     for(int i = 0; i < ctx->super_count; i++)
     {
-        u32 cluster = CLUSTER_COUNT - (ctx->super_count - i) * ISFSSUPER_CLUSTERS;
-
-        if(isfs_read_volume(ctx, cluster, 1, 0, NULL, slc_cluster_buf)<0)
-            continue;
-
-        int cur_version = _isfs_get_super_version(slc_cluster_buf);
+        int cur_version = ctx->supers[i].version;
         if(cur_version < 0) continue;
 
-        u32 cur_generation = _isfs_get_super_generation(slc_cluster_buf);
+        u32 cur_generation = ctx->supers[i].generation;
         if((cur_generation < newest.generation) ||
            (cur_generation < min_generation) ||
            (cur_generation >= max_generation))
@@ -664,6 +1077,12 @@ static int _isfs_load_super_range(isfs_ctx* ctx, u32 min_generation, u32 max_gen
 int isfs_load_super(isfs_ctx* ctx){
     u32 max_generation = 0xffffffff;
     ctx->isfshax = false;
+
+    /* the slot table survives remounts of raw NAND until something gets programmed;
+       redNAND and image files can change behind our back, so rescan those every time */
+    if(ctx->file || (ctx->bank & 0x80000000) || ctx->supers_stamp != nand_get_program_count())
+        ctx->supers_valid = false;
+
     int res = _isfs_load_super_range(ctx, ISFSHAX_GENERATION_FIRST, 0xffffffff);
     if(res>=0){
         if(read32((u32)ctx->super + ISFSHAX_INFO_OFFSET) == ISFSHAX_MAGIC){
@@ -704,6 +1123,11 @@ bool isfs_is_isfshax_super(isfs_ctx* ctx, u8 index){
 
 int isfs_commit_super(isfs_ctx* ctx)
 {
+    // the FAT is about to change, cached chains can't be trusted anymore
+    isfs_cache_invalidate(ctx, 0, CLUSTER_COUNT);
+    if(ctx->lookup)
+        _isfs_lookup_build(ctx);
+
     _isfs_get_hdr(ctx)->generation++;
 
     for(int i = 1; i <= ctx->super_count; i++)
@@ -801,11 +1225,42 @@ int isfs_open(isfs_file* file, const char* path)
 int isfs_close(isfs_file* file)
 {
     if(!file) return -1;
+    if(file->index) free(file->index);
     memset(file, 0, sizeof(isfs_file));
 
     return 0;
 }
 
+int isfs_build_index(isfs_file* file)
+{
+    if(!file) return -1;
+    if(file->index) return 0;
+
+    isfs_ctx* ctx = isfs_get_volume(file->volume);
+    isfs_fst* fst = file->fst;
+    if(!ctx || !fst) return -2;
+
+    u32 count = (fst->size + CLUSTER_SIZE - 1) / CLUSTER_SIZE;
+    u16* index = malloc(max(count, 1) * sizeof(u16));
+    if(!index) return -3;
+
+    u16* fat = _isfs_get_fat(ctx);
+    u16 cluster = fst->sub;
+    for(u32 i = 0; i < count; i++) {
+        if(cluster >= CLUSTER_COUNT) {
+            ISFS_debug("broken FAT chain in %.12s\n", fst->name);
+            free(index);
+            return -4;
+        }
+        index[i] = cluster;
+        cluster = fat[cluster];
+    }
+
+    file->index = index;
+    file->index_count = count;
+    return 0;
+}
+
 int isfs_seek(isfs_file* file, s32 offset, int whence)
 {
     if(!file) return -1;
@@ -834,14 +1289,21 @@ int isfs_seek(isfs_file* file, s32 offset, int whence)
             break;
     }
 
-    u16 sub = fst->sub;
-    size_t size = file->offset;
+    u32 cluster_idx = file->offset / CLUSTER_SIZE;
 
-    while(size > 8 * PAGE_SIZE) {
-        sub = _isfs_get_fat(ctx)[sub];
-        size -= 8 * PAGE_SIZE;
+    if(cluster_idx && !file->index)
+        isfs_build_index(file);
+
+    if(file->index) {
+        file->cluster = cluster_idx < file->index_count ? file->index[cluster_idx] : FAT_CLUSTER_LAST;
+        return 0;
     }
 
+    /* no memory for the index, walk the chain */
+    u16 sub = fst->sub;
+    while(cluster_idx-- && sub < CLUSTER_COUNT)
+        sub = _isfs_get_fat(ctx)[sub];
+
     file->cluster = sub;
 
     return 0;
@@ -859,22 +1321,45 @@ int isfs_read(isfs_file* file, void* buffer, size_t size, size_t* bytes_read)
         size = fst->size - file->offset;
 
     size_t total = size;
+    u16* fat = _isfs_get_fat(ctx);
 
     while(size) {
         size_t pos = file->offset % CLUSTER_SIZE;
+
+        /* whole clusters go straight to a DMA-able destination, one request per contiguous run */
+        if(!pos && size >= CLUSTER_SIZE && !((u32)buffer & (NAND_DATA_ALIGN - 1)) && file->cluster < CLUSTER_COUNT) {
+            u16 first = file->cluster;
+            u32 count = 1;
+            while((count + 1) * CLUSTER_SIZE <= size && fat[first + count - 1] == first + count)
+                count++;
+
+            if (isfs_read_volume(ctx, first, count, ISFSVOL_FLAG_ENCRYPTED, NULL, buffer) < 0)
+                return -4;
+
+            file->offset += count * CLUSTER_SIZE;
+            buffer += count * CLUSTER_SIZE;
+            size -= count * CLUSTER_SIZE;
+
+            file->cluster = fat[first + count - 1];
+            if(ctx->cache)
+                ctx->cache->last = first + count - 1;
+            continue;
+        }
+
         size_t copy = CLUSTER_SIZE - pos;
         if(copy > size) copy = size;
 
-        if (isfs_read_volume(ctx, file->cluster, 1, ISFSVOL_FLAG_ENCRYPTED, NULL, slc_cluster_buf) < 0)
+        u8* cluster_data = _isfs_cache_get(ctx, file->cluster);
+        if(!cluster_data)
             return -4;
-        memcpy(buffer, slc_cluster_buf + pos, copy);
+        memcpy(buffer, cluster_data + pos, copy);
 
         file->offset += copy;
         buffer += copy;
         size -= copy;
 
         if((pos + copy) >= CLUSTER_SIZE)
-            file->cluster = _isfs_get_fat(ctx)[file->cluster];
+            file->cluster = fat[file->cluster];
     }
 
     *bytes_read = total;
@@ -961,7 +1446,9 @@ int isfs_init(unsigned int volume)
     if(!ctx->super) ctx->super = memalign(NAND_DATA_ALIGN, 0x80 * PAGE_SIZE);
     if(!ctx->super) return -2;
 
+    int t = trace_begin("isfs_mount");
     int res = isfs_load_super(ctx);
+    trace_end(t);
     if(res){
         free(ctx->super);
         printf("Failed to mount %s! Wrong OTP?\n", ctx->name);
@@ -969,6 +1456,11 @@ int isfs_init(unsigned int volume)
     }
     ctx->mounted = true;
 
+    if(_isfs_cache_init(ctx))
+        printf("ISFS: no memory for %s cluster cache\n", ctx->name);
+    if(_isfs_lookup_build(ctx))
+        printf("ISFS: path lookup table for %s unavailable\n", ctx->name);
+
     int _isfsdev_init(isfs_ctx* ctx);
     _isfsdev_init(ctx);
 
@@ -991,6 +1483,9 @@ int isfs_unmount(int volume){
         ctx->super = NULL;
     }
 
+    _isfs_cache_free(ctx);
+    _isfs_lookup_free(ctx);
+
     RemoveDevice(ctx->name);
     ctx->mounted = false;
     ctx->isfshax = false;
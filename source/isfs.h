@@ -44,6 +44,16 @@
 #define FAT_CLUSTER_BAD         0xFFFD // bad block (marked at factory)
 #define FAT_CLUSTER_EMPTY       0xFFFE // empty (unused / available) space
 
+#define ISFS_CACHE_CLUSTERS     8 // decrypted clusters kept per volume
+#define ISFS_CACHE_READAHEAD    3 // clusters fetched ahead on sequential reads
+#define ISFS_CACHE_EMPTY        0xFFFF
+
+#define ISFS_FST_COUNT          ((ISFSSUPER_SIZE - 0x1000C) / sizeof(isfs_fst))
+#define ISFS_LOOKUP_SLOTS       0x2000 // power of two, > ISFS_FST_COUNT
+#define ISFS_LOOKUP_MAX_DEPTH   32
+
+#define ISFS_SUPER_SLOTS_MAX    64
+#define ISFS_SD_READ_CLUSTERS   8 // redNAND clusters per SD read, decrypted during the next one
 
 typedef struct {
     char name[12];
@@ -60,6 +70,29 @@ typedef struct {
 
 #include "isfshax.h"
 
+typedef struct {
+    u8* data;
+    u16 cluster[ISFS_CACHE_CLUSTERS];
+    u32 used[ISFS_CACHE_CLUSTERS];
+    u32 tick;
+    u16 last;
+    u32 hits;
+    u32 misses;
+    u32 readahead;
+} isfs_cache;
+
+// (parent directory, name) -> FST index, open addressing
+typedef struct {
+    u16 parent;
+    u16 fst;
+} isfs_lookup_slot;
+
+// header of every superblock slot, as seen by the last scan
+typedef struct {
+    u32 generation;
+    s8 version; // -1 if the slot holds no superblock
+} isfs_super_slot;
+
 typedef struct {
     int volume;
     const char name[0x10];
@@ -76,6 +109,12 @@ typedef struct {
     u8 hmac[0x14];
     devoptab_t devoptab;
     FIL* file;
+    u16* file_blocks; // slot of every block in a sparse raw image, NULL for a flat one
+    isfs_cache* cache;
+    isfs_lookup_slot* lookup;
+    isfs_super_slot supers[ISFS_SUPER_SLOTS_MAX];
+    bool supers_valid;
+    u32 supers_stamp;
 } isfs_ctx;
 
 typedef struct {
@@ -83,6 +122,8 @@ typedef struct {
     isfs_fst* fst;
     size_t offset;
     u16 cluster;
+    u16* index; // cluster of every file offset / CLUSTER_SIZE, built on first seek
+    u32 index_count;
 } isfs_file;
 
 typedef struct {
@@ -127,6 +168,7 @@ isfs_fst* isfs_stat(const char* path);
 int isfs_open(isfs_file* file, const char* path);
 int isfs_close(isfs_file* file);
 
+int isfs_build_index(isfs_file* file);
 int isfs_seek(isfs_file* file, s32 offset, int whence);
 int isfs_read(isfs_file* file, void* buffer, size_t size, size_t* bytes_read);
 
@@ -143,6 +185,9 @@ int isfs_commit_super(isfs_ctx* ctx);
 int isfs_super_mark_slot(isfs_ctx *ctx, u32 index, u16 marker);
 #endif
 
+void isfs_cache_invalidate(const isfs_ctx* ctx, u32 start_cluster, u32 cluster_count);
+void isfs_print_cache_stats(int volume);
+
 u16* _isfs_get_fat(isfs_ctx* ctx);
 
 bool isfs_slc_has_isfshax_installed(void);
@@ -0,0 +1,291 @@
+/*
+ *  minute - a port of the "mini" IOS replacement for the Wii U.
+ *
+ *  This code is licensed to you under the terms of the GNU GPL, version 2;
+ *  see file COPYING or http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#include "log.h"
+
+#ifndef MINUTE_BOOT1
+#include "serial.h"
+#include "gfx.h"
+#include "irq.h"
+#include "latte.h"
+#include "utils.h"
+#include "minini.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+// LT_TIMER runs at 1.9MHz
+#define LOG_TICKS_PER_S     1900000
+
+typedef struct {
+    int level; // messages less severe than this are skipped
+    u32 rate;
+    u32 window; // LT_TIMER at the start of the current second
+    u32 lines;
+    u32 dropped; // messages lost to the rate limit or a full ring
+
+    // the screen is drawn right away and has no ring
+    char* ring;
+    u32 size;
+    u32 head;
+    u32 tail;
+} log_sink;
+
+static char log_serial_ring[LOG_SERIAL_RING];
+static char log_file_ring[LOG_FILE_RING];
+
+static log_sink log_sinks[LOG_SINKS] = {
+    [LOG_SINK_SCREEN] = { .level = LOG_INFO },
+    [LOG_SINK_SERIAL] = { .level = LOG_INFO, .ring = log_serial_ring, .size = LOG_SERIAL_RING },
+    [LOG_SINK_FILE] = { .level = LOG_INFO, .ring = log_file_ring, .size = LOG_FILE_RING },
+};
+
+static const char* const log_prefix[] = {
+    [LOG_ERROR] = "[E] ",
+    [LOG_WARN] = "[W] ",
+    [LOG_INFO] = "",
+    [LOG_DEBUG] = "[D] ",
+};
+
+static FILE* log_file = NULL;
+static bool log_async = false;
+static volatile bool log_draining = false;
+
+static u32 _log_drain_serial(u32 budget)
+{
+    log_sink* sink = &log_sinks[LOG_SINK_SERIAL];
+    u32 sent = 0;
+
+    // bytes are bit-banged, so never start one while another is on the wire
+    u32 cookie = irq_kill();
+    if(log_draining || serial_busy()) {
+        irq_restore(cookie);
+        return 0;
+    }
+    log_draining = true;
+    irq_restore(cookie);
+
+    while(sent < budget && sink->tail != sink->head) {
+        char c = sink->ring[sink->tail & (sink->size - 1)];
+        if(c == '\n')
+            serial_line_inc();
+        serial_send(c);
+        sink->tail++;
+        sent++;
+    }
+
+    log_draining = false;
+    return sent;
+}
+
+static bool _log_push(log_sink* sink, const char* prefix, const char* str, u32 len)
+{
+    u32 plen = strlen(prefix);
+
+    u32 cookie = irq_kill();
+    bool fits = sink->size - (sink->head - sink->tail) >= plen + len;
+    if(fits) {
+        for(u32 i = 0; i < plen; i++)
+            sink->ring[sink->head++ & (sink->size - 1)] = prefix[i];
+        for(u32 i = 0; i < len; i++)
+            sink->ring[sink->head++ & (sink->size - 1)] = str[i];
+    }
+    irq_restore(cookie);
+
+    // a full serial ring is drained in place rather than losing the message
+    if(!fits && sink == &log_sinks[LOG_SINK_SERIAL] && plen + len <= sink->size &&
+       _log_drain_serial(plen + len - (sink->size - (sink->head - sink->tail))))
+        return _log_push(sink, prefix, str, len);
+    return fits;
+}
+
+static bool _log_allow(log_sink* sink, int level, u32 lines, u32 now)
+{
+    if(!sink->rate || level == LOG_ERROR)
+        return true;
+
+    if(now - sink->window >= LOG_TICKS_PER_S) {
+        sink->window = now;
+        sink->lines = 0;
+    }
+    if(sink->lines >= sink->rate)
+        return false;
+
+    sink->lines += lines;
+    return true;
+}
+
+static bool _log_emit(int index, int level, const char* str, u32 len)
+{
+    log_sink* sink = &log_sinks[index];
+
+    if(!sink->ring) {
+        gfx_console_write(str);
+        return true;
+    }
+    return _log_push(sink, log_prefix[level], str, len);
+}
+
+void log_puts(int level, const char* str)
+{
+    u32 len = strlen(str), lines = 0;
+    u32 now = read32(LT_TIMER);
+
+    for(u32 i = 0; i < len; i++)
+        if(str[i] == '\n') lines++;
+
+    for(int i = 0; i < LOG_SINKS; i++) {
+        log_sink* sink = &log_sinks[i];
+
+        if(level > sink->level || (i == LOG_SINK_FILE && !log_file))
+            continue;
+        if(!_log_allow(sink, level, lines, now)) {
+            sink->dropped++;
+            continue;
+        }
+
+        if(sink->dropped) {
+            char note[48];
+            u32 note_len = snprintf(note, sizeof(note), "log: %lu messages dropped\n", sink->dropped);
+            if(!_log_emit(i, LOG_WARN, note, note_len)) {
+                sink->dropped++;
+                continue;
+            }
+            sink->dropped = 0;
+        }
+
+        if(!_log_emit(i, level, str, len))
+            sink->dropped++;
+    }
+
+    if(!log_async)
+        _log_drain_serial(~0);
+}
+
+int log_printf(int level, const char* fmt, ...)
+{
+    static char str[0x800];
+    va_list va;
+
+    va_start(va, fmt);
+    vsnprintf(str, sizeof(str), fmt, va);
+    va_end(va);
+
+    log_puts(level, str);
+    return 0;
+}
+
+void log_set_level(int sink, int level)
+{
+    if(sink >= 0 && sink < LOG_SINKS)
+        log_sinks[sink].level = level;
+}
+
+void log_set_rate(int sink, u32 rate)
+{
+    if(sink >= 0 && sink < LOG_SINKS)
+        log_sinks[sink].rate = rate;
+}
+
+int log_file_open(const char* path)
+{
+    if(log_file)
+        return 0;
+
+    log_file = fopen(path, "w");
+    if(!log_file) {
+        printf("log: failed to open `%s`!\n", path);
+        return -1;
+    }
+
+    log_sink* sink = &log_sinks[LOG_SINK_FILE];
+    sink->head = sink->tail = 0;
+    sink->dropped = 0;
+    return 0;
+}
+
+void log_start(void)
+{
+#ifdef CAN_HAZ_IRQ
+    log_async = true;
+    irq_set_alarm(LOG_DRAIN_MS, 1);
+    irq_enable(IRQ_TIMER);
+#endif
+}
+
+void log_stop(void)
+{
+#ifdef CAN_HAZ_IRQ
+    irq_disable(IRQ_TIMER);
+    irq_set_alarm(0, 0);
+#endif
+    log_async = false;
+
+    log_idle();
+    if(log_file) {
+        fclose(log_file);
+        log_file = NULL;
+    }
+}
+
+void log_irq(void)
+{
+    if(log_async)
+        _log_drain_serial(LOG_DRAIN_CHARS);
+}
+
+void log_poll(void)
+{
+    if(log_async)
+        _log_drain_serial(LOG_POLL_CHARS);
+}
+
+void log_flush(void)
+{
+    _log_drain_serial(~0);
+}
+
+void log_idle(void)
+{
+    log_sink* sink = &log_sinks[LOG_SINK_FILE];
+
+    log_flush();
+    if(!log_file || sink->tail == sink->head)
+        return;
+
+    // at most two pieces, the end of the ring and its start
+    while(sink->tail != sink->head) {
+        u32 offset = sink->tail & (sink->size - 1);
+        u32 len = min(sink->head - sink->tail, sink->size - offset);
+        if(fwrite(&sink->ring[offset], 1, len, log_file) != len)
+            break;
+        sink->tail += len;
+    }
+    fflush(log_file);
+}
+
+int log_ini(const char* key, const char* value)
+{
+    if(!strcmp(key, "screen_level"))
+        log_set_level(LOG_SINK_SCREEN, (int)minini_get_uint(value, LOG_INFO));
+    else if(!strcmp(key, "serial_level"))
+        log_set_level(LOG_SINK_SERIAL, (int)minini_get_uint(value, LOG_INFO));
+    else if(!strcmp(key, "file_level"))
+        log_set_level(LOG_SINK_FILE, (int)minini_get_uint(value, LOG_INFO));
+    else if(!strcmp(key, "screen_rate"))
+        log_set_rate(LOG_SINK_SCREEN, (u32)minini_get_uint(value, 0));
+    else if(!strcmp(key, "serial_rate"))
+        log_set_rate(LOG_SINK_SERIAL, (u32)minini_get_uint(value, 0));
+    else if(!strcmp(key, "file_rate"))
+        log_set_rate(LOG_SINK_FILE, (u32)minini_get_uint(value, 0));
+    else if(!strcmp(key, "file") && minini_get_bool(value, 0))
+        log_file_open(LOG_FILE);
+
+    return 0;
+}
+#endif // !MINUTE_BOOT1
@@ -0,0 +1,67 @@
+/*
+ *  minute - a port of the "mini" IOS replacement for the Wii U.
+ *
+ *  This code is licensed to you under the terms of the GNU GPL, version 2;
+ *  see file COPYING or http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#ifndef _LOG_H
+#define _LOG_H
+
+#include "types.h"
+
+#define LOG_ERROR           0
+#define LOG_WARN            1
+#define LOG_INFO            2
+#define LOG_DEBUG           3
+
+#define LOG_SINK_SCREEN     0
+#define LOG_SINK_SERIAL     1
+#define LOG_SINK_FILE       2
+#define LOG_SINKS           3
+
+#define LOG_SERIAL_RING     0x4000 // power of two
+#define LOG_FILE_RING       0x8000 // power of two
+#define LOG_DRAIN_MS        1
+#define LOG_DRAIN_CHARS     8 // per timer tick
+#define LOG_POLL_CHARS      1 // per log_poll, short enough to not delay the caller
+
+#define LOG_FILE            "sdmc:/minute/minute.log"
+
+#ifdef MINUTE_BOOT1
+static inline int log_printf(int level, const char* fmt, ...)
+{
+    return 0;
+}
+static inline void log_puts(int level, const char* str) {}
+static inline void log_irq(void) {}
+static inline void log_poll(void) {}
+static inline void log_idle(void) {}
+static inline void log_flush(void) {}
+static inline int log_ini(const char* key, const char* value)
+{
+    return 0;
+}
+#else
+int log_printf(int level, const char* fmt, ...);
+void log_puts(int level, const char* str);
+
+void log_set_level(int sink, int level);
+// lines per second, errors are never limited, 0 disables the limit
+void log_set_rate(int sink, u32 rate);
+int log_file_open(const char* path);
+
+// serial output is queued and drained by the timer IRQ until log_stop
+void log_start(void);
+void log_stop(void);
+void log_irq(void);
+
+// idle points: log_poll is safe anywhere, log_idle needs the SD card to be free
+void log_poll(void);
+void log_idle(void);
+void log_flush(void);
+
+int log_ini(const char* key, const char* value);
+#endif
+
+#endif
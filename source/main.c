@@ -53,12 +53,15 @@
 #include "isfshax.h"
 #include "rednand.h"
 #include "isfshax_patch.h"
+#include "trace.h"
+#include "log.h"
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <malloc.h>
 #include <dirent.h>
 
+// print the boot trace on the console before jumping to IOS
 //#define MEASURE_TIME
 
 static struct {
@@ -79,6 +82,11 @@ bool minute_on_sd = false;
 int main_is_de_Fused = 0;
 int main_force_pause = 0;
 int main_allow_legacy_patches = 0;
+#ifdef MEASURE_TIME
+int main_boot_trace = 1;
+#else
+int main_boot_trace = 0; // write the boot trace files to SD
+#endif
 
 int main_autoboot(void);
 void main_quickboot_patch_slc(void);
@@ -628,9 +636,10 @@ u32 _main(void *base)
     bool no_gpu = false;
 #endif
     bool no_menu = no_gpu;
-#ifdef MEASURE_TIME
-    u32 minute_start_time = read32(LT_TIMER);
-#endif
+    trace_init();
+    int t_main = trace_begin("minute");
+    int t_init = trace_begin("init");
+    int t_early = trace_begin("early");
 
     write32(LT_SRNPROT, 0x7BF);
     exi_init();
@@ -723,16 +732,13 @@ u32 _main(void *base)
             }
         }
     }
-#ifdef MEASURE_TIME
-    u32 graphic_start = read32(LT_TIMER);
-#endif
+    trace_end(t_early);
     if(!no_gpu) {
+        int t = trace_begin("gpu_init");
         gpu_display_init();
         gfx_init();
+        trace_end(t);
     }
-#ifdef MEASURE_TIME
-    u32 graphic_end = read32(LT_TIMER);
-#endif
 
     printf("minute loading\n");
 
@@ -754,37 +760,42 @@ u32 _main(void *base)
         printf("boot_info source: pre-decrypted PRSH not from boot1\n");
     }
 
+    int t_stage = trace_begin("mem_init");
     printf("Initializing exceptions...\n");
     exception_initialize();
     printf("Configuring caches and MMU...\n");
     mem_initialize();
+    trace_end(t_stage);
 
+    t_stage = trace_begin("irq_init");
     irq_initialize();
+    log_start();
     printf("Interrupts initialized\n");
+    trace_end(t_stage);
 
+    t_stage = trace_begin("crypto_init");
     srand(read32(LT_TIMER));
     crypto_initialize();
     printf("crypto support initialized\n");
     latte_print_hardware_info();
+    trace_end(t_stage);
 
     printf("Initializing SD card...\n");
-#ifdef MEASURE_TIME
-    u32 sd_start = read32(LT_TIMER);
-    u32 sd_end = sd_start;
-#endif
 #ifndef FASTBOOT
+    t_stage = trace_begin("sd_init");
     sdcard_init();
     printf("sdcard_init finished\n");
+    trace_end(t_stage);
 
     printf("Mounting SD card...\n");
+    t_stage = trace_begin("sd_mount");
     res = ELM_Mount();
     if(res) {
         printf("Error while mounting SD card (%d).\n", res);
     }
-#ifdef MEASURE_TIME
-    sd_end = read32(LT_TIMER);
-#endif
+    trace_end(t_stage);
 
+    t_stage = trace_begin("otp_seeprom");
     crypto_check_de_Fused();
 
 
@@ -848,9 +859,11 @@ u32 _main(void *base)
 
     // Hopefully we have proper keys by this point
     crypto_decrypt_seeprom();
+    trace_end(t_stage);
 
 #endif // FASTBOOT
 
+    t_stage = trace_begin("prsh");
     if (prsh_is_encrypted)
     {
         printf("prsh: decrypting.\n");
@@ -859,6 +872,7 @@ u32 _main(void *base)
 
     prsh_reset();
     prsh_init();
+    trace_end(t_stage);
 
 #ifndef FASTBOOT
     int isfshax_refresh = 0;
@@ -895,14 +909,14 @@ u32 _main(void *base)
         minute_on_slc = true;
         minute_on_sd = false;
     }
-#ifdef MEASURE_TIME
-    u32 ini_start = read32(LT_TIMER);
-#endif
 #ifndef FASTBOOT
+    t_stage = trace_begin("ini");
     minini_init();
-#endif
-#ifdef MEASURE_TIME
-    u32 ini_end = read32(LT_TIMER);
+    trace_end(t_stage);
+
+    // the last boot handed its trace over in PRSH
+    if (main_boot_trace)
+        trace_save_previous(TRACE_FILE_PREV);
 #endif
 
     // idk?
@@ -941,16 +955,17 @@ u32 _main(void *base)
         printf("Power button spam, showing menu...\n");
         autoboot = false;
     }
-#ifdef MEASURE_TIME
-    u32 init_end = read32(LT_TIMER);
-#endif
+    trace_end(t_init);
 
 #ifdef FASTBOOT
+    t_stage = trace_begin("quickboot");
     main_quickboot_patch_slc();
+    trace_end(t_stage);
 #else
     // Prompt user to skip autoboot, time = 0 will skip this.
     if(autoboot)
     {
+        t_stage = trace_begin("autoboot_wait");
         while((autoboot_timeout_s-- > 0) && autoboot)
         {
             printf("Autobooting in %d seconds...\n", (int)autoboot_timeout_s + 1);
@@ -969,6 +984,7 @@ u32 _main(void *base)
                 }
             }
         }
+        trace_end(t_stage);
     }
     
     // Try to autoboot if specified, if it fails just load the menu.
@@ -1000,8 +1016,12 @@ u32 _main(void *base)
 #endif // !FASTBOOT
 
 skip_menu:
-#ifdef MEASURE_TIME
-    u32 deinit_start = read32(LT_TIMER);
+    t_stage = trace_begin("deinit");
+
+#ifndef FASTBOOT
+    // last chance while the SD card is still mounted
+    if (main_boot_trace && boot.mode == 0 && boot.vector)
+        trace_write_json(TRACE_FILE);
 #endif
 
     if(!no_gpu)
@@ -1010,6 +1030,9 @@ skip_menu:
     printf("Unmounting SLC...\n");
     isfs_fini();
 
+    // everything after this goes out synchronously again
+    log_stop();
+
 #ifndef FASTBOOT
     printf("Shutting down MLC...\n");
     mlc_exit();
@@ -1050,24 +1073,12 @@ skip_menu:
         case 3: smc_reset_no_defuse(); break;
     }
 
+    trace_end(t_stage);
+    trace_end(t_main);
+    trace_begin("ios_launch");
 #ifdef MEASURE_TIME
-    u32 end = read32(LT_TIMER);
-    printf( "minute:        %u\n"
-            " init:         %u\n"
-            "  pre graphic  %u\n"
-            "  graphic      %u\n"
-            "  graph-> sd   %u\n"
-            "  sd           %u\n"
-            "  sd -> ini    %u\n"
-            "  ini          %u\n"
-            "  ini -> end   %u\n"
-            " loading:      %u\n"
-            " deinit        %u\n",
-            end-minute_start_time,
-            init_end-minute_start_time, graphic_start-minute_start_time, graphic_end-graphic_start, 
-            sd_start-graphic_end, sd_end-sd_start, ini_start-sd_end, ini_end-ini_start, init_end-ini_end,
-            deinit_start-init_end, end-deinit_start);
-#endif // MEASURE_TIME
+    trace_print();
+#endif
 
     printf("Jumping to IOS... GO GO GO\n");
 
@@ -1091,6 +1102,8 @@ int boot_ini(const char* key, const char* value)
         main_force_pause = minini_get_bool(value, 0);
     else if(!strcmp(key, "allow_legacy_patches"))
         main_allow_legacy_patches = minini_get_bool(value, 0);
+    else if(!strcmp(key, "boot_trace"))
+        main_boot_trace = minini_get_bool(value, 0);
 
     return 0;
 }
@@ -1104,7 +1117,9 @@ int main_autoboot(void)
     menu_main.selected = autoboot-1;
     menu_item entry = menu_main.option[menu_main.selected];
     printf("Autobooting %i: %s\n", autoboot, entry.text);
+    int t = trace_begin("autoboot");
     entry.callback();
+    trace_end(t);
     return 0;
 }
 
@@ -1157,7 +1172,9 @@ void main_boot_ppc(void)
     pick_file("sdmc:", false, path);
 
     u32 entry = 0;
+    int t = trace_begin("ppc_load");
     int res = ppc_load_file(path, &entry);
+    trace_end(t);
     if(res) {
         printf("ppc_load_file: %d\n", res);
         goto ppc_exit;
@@ -16,6 +16,7 @@
 #include "ini.h"
 #include "minini.h"
 #include "gpu.h"
+#include "log.h"
 
 struct {
     const char* section;
@@ -24,6 +25,7 @@ struct {
     {"mcp", mcp_ini},
     {"boot", boot_ini},
     {"clocks", clocks_ini},
+    {"log", log_ini},
 
     {NULL, NULL}
 };
@@ -45,6 +45,7 @@ struct mlc_ctx {
     int new_card; // set to 1 everytime a new card is inserted
 
     u32 num_sectors;
+    u32 erase_sectors; // erase group size, 0 if unknown
     u16 rca;
 
     bool is_sd;
@@ -182,6 +183,8 @@ static void _discover_emmc(void){
     printf("taac=%u nsac=%u read_bl_len=%u c_size=%u c_size_mult=%u card size=%u bytes\n",
         taac, nsac, read_bl_len, c_size, c_size_mult, (c_size + 1) * (4 << c_size_mult) * (1 << read_bl_len));
     card.num_sectors = (c_size + 1) * (4 << c_size_mult) * (1 << read_bl_len) / 512;
+    // replaced by the high capacity size from EXT_CSD if that's in use
+    card.erase_sectors = (MMC_CSD_ERASE_GRP_SIZE(resp32) + 1) * (MMC_CSD_ERASE_GRP_MULT(resp32) + 1);
 
 
     DPRINTF(1, ("mlc: enabling clock\n"));
@@ -259,6 +262,11 @@ static void _discover_emmc(void){
     card.num_sectors = (u32)ext_csd[0xD4] | ext_csd[0xD5] << 8 | ext_csd[0xD6] << 16 | ext_csd[0xD7] << 24;
     printf("mlc: card_type=0x%x sec_count=0x%lx\n", card_type, card.num_sectors);
 
+    // ERASE_GROUP_DEF, HC_ERASE_GRP_SIZE in 512KiB units
+    if((ext_csd[0xAF] & 1) && ext_csd[0xE0])
+        card.erase_sectors = ext_csd[0xE0] * 1024;
+    printf("mlc: erase group 0x%lx sectors\n", card.erase_sectors);
+
     if(!(card_type & 0xE)){
         printf("mlc: no SDR25 support\n");
         return;
@@ -312,6 +320,7 @@ void mlc_needs_discover(void)
 
     DPRINTF(0, ("mlc: card needs discovery.\n"));
     card.new_card = 1;
+    card.erase_sectors = 0;
 
     if (!sdhc_card_detect(card.handle)) {
         DPRINTF(1, ("mlc: card (no longer?) inserted.\n"));
@@ -479,6 +488,7 @@ void mlc_needs_discover(void)
         printf("mlc: sdhc mode, c_size=%u, card size = %uk\n", c_size, (c_size + 1)* 512);
         card.num_sectors = (c_size + 1) * 1024; // number of 512-byte sectors
     }
+    card.erase_sectors = SD_CSD_SECTOR_SIZE(resp32) + 1;
 
     DPRINTF(1, ("mlc: enabling clock\n"));
     if (sdhc_bus_clock(card.handle, SDMMC_SDCLK_25MHZ, SDMMC_TIMING_LEGACY) != 0) {
@@ -733,6 +743,30 @@ int mlc_end_read(struct sdmmc_command* cmdbuf)
     return 0;
 }
 
+int mlc_async_done(struct sdmmc_command* cmdbuf)
+{
+    return sdhc_async_done(card.handle, cmdbuf);
+}
+
+u32 mlc_max_blocks(void)
+{
+    return sdhc_max_blocks(card.handle);
+}
+
+// retries a command that failed on ADMA2 in pieces SDMA can take
+static int _mlc_retry_sdma(int (*fn)(u32, u32, void*), u32 blk_start, u32 blk_count, void *data)
+{
+    u32 max = sdhc_max_blocks(card.handle);
+
+    printf("mlc: retrying over SDMA\n");
+    for (u32 done = 0; done < blk_count; done += max) {
+        int res = fn(blk_start + done, min(blk_count - done, max), (u8*)data + done * SDMMC_DEFAULT_BLOCKLEN);
+        if (res)
+            return res;
+    }
+    return 0;
+}
+
 int mlc_read(u32 blk_start, u32 blk_count, void *data)
 {
     struct sdmmc_command cmd;
@@ -776,6 +810,8 @@ int mlc_read(u32 blk_start, u32 blk_count, void *data)
 
     if (cmd.c_error) {
         printf("mlc: MMC_READ_BLOCK_%s failed with %d\n", blk_count > 1 ? "MULTIPLE" : "SINGLE", cmd.c_error);
+        if (sdhc_adma_failed(card.handle))
+            return _mlc_retry_sdma(mlc_read, blk_start, blk_count, data);
         return -1;
     }
     if(blk_count > 1)
@@ -925,6 +961,8 @@ int mlc_write(u32 blk_start, u32 blk_count, void *data)
 
     if (cmd.c_error) {
         printf("mlc: MMC_WRITE_BLOCK_%s failed with %d\n", blk_count > 1 ? "MULTIPLE" : "SINGLE", cmd.c_error);
+        if (sdhc_adma_failed(card.handle))
+            return _mlc_retry_sdma(mlc_write, blk_start, blk_count, data);
         return -1;
     }
     if(blk_count > 1)
@@ -981,7 +1019,20 @@ void mlc_irq(void)
 }
 
 
-static int mlc_do_erase(u32 start, u32 end){
+u32 mlc_erase_sectors(void)
+{
+#ifndef MLC_SUPPORT_WRITE
+    return 0;
+#else
+    // erase addresses are only sectors in block mode
+    if (card.inserted == 0 || card.new_card == 1 || !card.sdhc_blockmode)
+        return 0;
+
+    return card.erase_sectors;
+#endif
+}
+
+int mlc_do_erase(u32 start, u32 end){
 #ifndef MLC_SUPPORT_WRITE
     return -1;
 #else
@@ -1075,6 +1126,9 @@ static void _mlc_do_init(void){
         .abort = &mlc_abort,
         .rb = RB_SD2,
         .wb = WB_SD2,
+#ifdef CAN_HAZ_IRQ
+        .irq = 1,
+#endif
     };
 
 #ifdef CAN_HAZ_IRQ
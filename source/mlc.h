@@ -38,6 +38,11 @@ int mlc_end_read(struct sdmmc_command* cmdbuf);
 int mlc_start_write(u32 blk_start, u32 blk_count, void *data, struct sdmmc_command* cmdbuf);
 int mlc_end_write(struct sdmmc_command* cmdbuf);
 
+int mlc_async_done(struct sdmmc_command* cmdbuf);
+u32 mlc_max_blocks(void); // per command, 256 without ADMA
+
 int mlc_erase(void);
+int mlc_do_erase(u32 start, u32 end);
+u32 mlc_erase_sectors(void); // erase group size, 0 if unknown
 
 #endif
@@ -20,6 +20,7 @@
 #include "crypto.h"
 #include "irq.h"
 #include "gfx.h"
+#include "log.h"
 #include "types.h"
 
 //#define NAND_DEBUG  1
@@ -64,6 +65,7 @@
 static u32 initialized = 0;
 static volatile int irq_flag;
 static u32 last_page_read = 0;
+static u32 program_count = 0;
 #if defined(NAND_SUPPORT_ERASE) || defined(NAND_SUPPORT_WRITE)
 static u32 nand_min_page = 0x200; // default to protecting boot1+boot2
 static u8 nand_status_buf[STATUS_BUF_SIZE] ALIGNED(NAND_DATA_ALIGN);
@@ -216,9 +218,14 @@ void nand_wait(void) {
     }
 }
 
-int nand_read_page(u32 pageno, void *data, void *ecc) {
+/* only one page read can be in flight, its buffers are needed again when it completes */
+static void *read_data, *read_ecc;
+
+int nand_start_read_page(u32 pageno, void *data, void *ecc) {
     irq_flag = 0;
     last_page_read = pageno;  // needed for error reporting
+    read_data = data;
+    read_ecc = ecc;
     __nand_set_address(0, pageno);
     nand_send_command(NAND_READ_PRE, 0x1f, 0, 0);
 
@@ -228,19 +235,29 @@ int nand_read_page(u32 pageno, void *data, void *ecc) {
     __nand_wait();
     __nand_setup_dma(data, ecc);
     nand_send_command(NAND_READ_POST, 0, NAND_FLAGS_IRQ | NAND_FLAGS_WAIT | NAND_FLAGS_RD | NAND_FLAGS_ECC, 0x840);
+    return 0;
+}
+
+int nand_end_read_page(void) {
     nand_wait();
     write32(NAND_CTRL, 0);
     ahb_flush_from(WB_FLA);
-    dc_invalidaterange(data, PAGE_SIZE);
-    dc_invalidaterange(ecc, ECC_BUFFER_ALLOC);
+    dc_invalidaterange(read_data, PAGE_SIZE);
+    dc_invalidaterange(read_ecc, ECC_BUFFER_ALLOC);
     if (read32(NAND_CTRL) & NAND_ERROR)
         return -1;
     return 0;
 }
 
+int nand_read_page(u32 pageno, void *data, void *ecc) {
+    nand_start_read_page(pageno, data, ecc);
+    return nand_end_read_page();
+}
+
 #ifdef NAND_SUPPORT_WRITE
 int nand_write_page_raw(u32 pageno, void *data, void *ecc) {
     irq_flag = 0;
+    program_count++;
     NAND_debug("nand_write_page_raw(%u, %p, %p)\n", pageno, data, ecc);
 
 #if 0
@@ -267,6 +284,7 @@ int nand_write_page_raw(u32 pageno, void *data, void *ecc) {
 
 int nand_write_page(u32 pageno, void *data, void *spare) {
     irq_flag = 0;
+    program_count++;
     NAND_debug("nand_write_page(%u, %p, %p)\n", pageno, data, spare);
 
 #if 0
@@ -329,6 +347,7 @@ int nand_write_page(u32 pageno, void *data, void *spare) {
 #ifdef NAND_SUPPORT_ERASE
 int nand_erase_block(u32 pageno) {
     irq_flag = 0;
+    program_count++;
     NAND_debug("nand_erase_block(%d)\n", pageno);
 
 #if 0
@@ -351,6 +370,12 @@ int nand_erase_block(u32 pageno) {
 }
 #endif
 
+// bumped on every program/erase, lets callers tell whether cached flash contents went stale
+u32 nand_get_program_count(void)
+{
+    return program_count;
+}
+
 void nand_initialize(u32 bank)
 {
     if(initialized == bank) return;
@@ -373,6 +398,11 @@ int nand_correct(u32 pageno, void *data, void *ecc)
     int uncorrectable = 0;
     int corrected = 0;
 
+    /* the common case: every chunk matches, nothing to decode */
+    if (!((ecc_read[0] ^ ecc_calc[0]) | (ecc_read[1] ^ ecc_calc[1]) |
+          (ecc_read[2] ^ ecc_calc[2]) | (ecc_read[3] ^ ecc_calc[3])))
+        return NAND_ECC_OK;
+
     for(i=0;i<4;i++) {
         u32 syndrome = *ecc_read ^ *ecc_calc; //calculate ECC syncrome
         // don't try to correct unformatted pages (all FF)
@@ -380,18 +410,15 @@ int nand_correct(u32 pageno, void *data, void *ecc)
             if(!((syndrome-1)&syndrome)) {
                 // single-bit error in ECC
                 corrected++;
+            } else if(((syndrome ^ (syndrome >> 16)) & 0xff0f) != 0xff0f) {
+                // a single data bit flips the odd half to the complement of the
+                // even half, checked on the whole word; anything else can't be fixed
+                uncorrectable++;
             } else {
-                // byteswap and extract odd and even halves
-                u16 even = (syndrome >> 24) | ((syndrome >> 8) & 0xf00);
-                u16 odd = ((syndrome << 8) & 0xf00) | ((syndrome >> 8) & 0x0ff);
-                if((even ^ odd) != 0xfff) {
-                    // oops, can't fix this one
-                    uncorrectable++;
-                } else {
-                    // fix the bad bit
-                    dp[odd >> 3] ^= 1<<(odd&7);
-                    corrected++;
-                }
+                // fix the bad bit, its position is the odd half byteswapped
+                u32 odd = ((syndrome >> 8) & 0x0ff) | ((syndrome << 8) & 0xf00);
+                dp[odd >> 3] ^= 1<<(odd&7);
+                corrected++;
             }
         }
         dp += 0x200;
@@ -399,7 +426,7 @@ int nand_correct(u32 pageno, void *data, void *ecc)
         ecc_calc++;
     }
     if(uncorrectable || corrected)
-        printf("ECC stats for NAND page 0x%lX: %d uncorrectable, %d corrected\n", pageno, uncorrectable, corrected);
+        log_printf(LOG_WARN, "ECC stats for NAND page 0x%lX: %d uncorrectable, %d corrected\n", pageno, uncorrectable, corrected);
     if(uncorrectable)
         return NAND_ECC_UNCORRECTABLE;
     if(corrected)
@@ -407,6 +434,102 @@ int nand_correct(u32 pageno, void *data, void *ecc)
     return NAND_ECC_OK;
 }
 
+// parity of the low byte, the 16 nibble parities are packed into 0x6996
+static inline u32 _nand_parity8(u32 x)
+{
+    x ^= x >> 4;
+    return (0x6996 >> (x & 0xF)) & 1;
+}
+
+// xor of the four bytes of a word
+static inline u32 _nand_fold32(u32 x)
+{
+    x ^= x >> 16;
+    x ^= x >> 8;
+    return x & 0xFF;
+}
+
+// byte at memory offset k of a word loaded from memory
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define ECC_WORD_BYTE(w, k) (((w) >> (24 - 8 * (k))) & 0xFF)
+#else
+#define ECC_WORD_BYTE(w, k) (((w) >> (8 * (k))) & 0xFF)
+#endif
+
+/*
+ * Hamming ECC of one 512 byte chunk. Bit j (3..11) covers the bytes whose
+ * index has bit j-3 set (odd half) or clear (even half), bits 0..2 are the
+ * column parities of the xor of all bytes. Byte index bits 0 and 1 select the
+ * byte within a word, bits 2..4 the word within a block of eight and
+ * bits 5..8 the block, so every word is only touched a handful of times.
+ */
+static void _nand_ecc_chunk(const u32* words, u8* ecc)
+{
+    u32 all = 0, lines[7] = {0};
+
+    for (u32 b = 0; b < 16; b++, words += 8)
+    {
+        u32 w0 = words[0], w1 = words[1], w2 = words[2], w3 = words[3];
+        u32 w4 = words[4], w5 = words[5], w6 = words[6], w7 = words[7];
+        u32 blk = w0 ^ w1 ^ w2 ^ w3 ^ w4 ^ w5 ^ w6 ^ w7;
+
+        lines[0] ^= w1 ^ w3 ^ w5 ^ w7;
+        lines[1] ^= w2 ^ w3 ^ w6 ^ w7;
+        lines[2] ^= w4 ^ w5 ^ w6 ^ w7;
+        if (b & 1) lines[3] ^= blk;
+        if (b & 2) lines[4] ^= blk;
+        if (b & 4) lines[5] ^= blk;
+        if (b & 8) lines[6] ^= blk;
+        all ^= blk;
+    }
+
+    u32 total = _nand_fold32(all);
+    u32 odd[9];
+    odd[0] = ECC_WORD_BYTE(all, 1) ^ ECC_WORD_BYTE(all, 3);
+    odd[1] = ECC_WORD_BYTE(all, 2) ^ ECC_WORD_BYTE(all, 3);
+    for (int j = 0; j < 7; j++)
+        odd[2 + j] = _nand_fold32(lines[j]);
+
+    u32 a0 = _nand_parity8(total & 0x55) | _nand_parity8(total & 0x33) << 1 | _nand_parity8(total & 0x0f) << 2;
+    u32 a1 = _nand_parity8(total & 0xaa) | _nand_parity8(total & 0xcc) << 1 | _nand_parity8(total & 0xf0) << 2;
+    for (int j = 0; j < 9; j++)
+    {
+        a0 |= _nand_parity8(total ^ odd[j]) << (3 + j);
+        a1 |= _nand_parity8(odd[j]) << (3 + j);
+    }
+
+    ecc[0] = a0;
+    ecc[1] = a0 >> 8;
+    ecc[2] = a1;
+    ecc[3] = a1 >> 8;
+}
+
+void nand_create_ecc(void* in_data, void* spare_out)
+{
+    u32 aligned[0x200 / sizeof(u32)];
+
+    u8* spare_buf = PTR_OFFS(spare_out, 0x0);
+    memset(spare_buf, 0, 0x40);
+    spare_buf[0] = 0xFF;
+
+    u8* ecc = PTR_OFFS(spare_out, 0x30);
+    const u8* data = (u8*)in_data;
+
+    for (int k = 0; k < 4; k++)
+    {
+        if ((u32)data & 3) {
+            memcpy(aligned, data, sizeof(aligned));
+            _nand_ecc_chunk(aligned, ecc);
+        } else {
+            _nand_ecc_chunk((const u32*)data, ecc);
+        }
+
+        data += 512;
+        ecc += 4;
+    }
+}
+
+#ifndef MINUTE_BOOT1
 static u8 _nand_parity(u8 x)
 {
     u8 y = 0;
@@ -418,7 +541,8 @@ static u8 _nand_parity(u8 x)
     return y;
 }
 
-void nand_create_ecc(void* in_data, void* spare_out)
+// original bit-at-a-time implementation, kept to check the fast one against
+static void _nand_create_ecc_ref(void* in_data, void* spare_out)
 {
     u8 a[12][2];
     u32 a0, a1;
@@ -470,3 +594,65 @@ void nand_create_ecc(void* in_data, void* spare_out)
         ecc += 4;
     }
 }
+
+/* compares both ECC generators on pseudo-random pages (plus an unaligned copy)
+   and prints how long each one took, then flips a bit in a few of them and
+   checks that nand_correct() puts it back */
+int nand_ecc_test(u32 pages)
+{
+    static u8 page[PAGE_SIZE + 4] ALIGNED(NAND_DATA_ALIGN);
+    u8 spare_ref[PAGE_SPARE_SIZE], spare_fast[PAGE_SPARE_SIZE];
+    u8 ecc_buf[ECC_BUFFER_ALLOC];
+    u32 seed = read32(LT_TIMER), ticks_ref = 0, ticks_fast = 0, mismatches = 0;
+    u32 flips = 0, missed = 0;
+
+    for (u32 n = 0; n < pages; n++)
+    {
+        u8* data = page + (n & 1);
+        for (u32 i = 0; i < PAGE_SIZE; i++) {
+            seed = seed * 1103515245 + 12345;
+            data[i] = seed >> 16;
+        }
+        // sprinkle in the patterns a real SLC mostly contains
+        if (n % 4 == 2) memset(data, 0xFF, PAGE_SIZE);
+        if (n % 4 == 3) memset(data, 0x00, PAGE_SIZE / 2);
+
+        u32 start = read32(LT_TIMER);
+        _nand_create_ecc_ref(data, spare_ref);
+        u32 mid = read32(LT_TIMER);
+        nand_create_ecc(data, spare_fast);
+        u32 end = read32(LT_TIMER);
+
+        ticks_ref += mid - start;
+        ticks_fast += end - mid;
+        if (memcmp(spare_ref, spare_fast, PAGE_SPARE_SIZE)) {
+            if (!mismatches)
+                printf("ECC mismatch on page %lu (offset %lu)\n", n, n & 1);
+            mismatches++;
+        }
+
+        // every correction logs a warning, so only the first few random pages
+        if (n % 4 == 0 && n < 16) {
+            u32 bit = (seed >> 16) % (PAGE_SIZE * 8);
+            u8 good = data[bit >> 3];
+
+            data[bit >> 3] ^= 1 << (bit & 7);
+            nand_create_ecc(data, spare_ref);
+            memcpy(ecc_buf + 0x30, spare_fast + 0x30, 0x10);
+            memcpy(ecc_buf + 0x40, spare_ref + 0x30, 0x10);
+
+            int ret = nand_correct(n, data, ecc_buf);
+            if (ret != NAND_ECC_CORRECTED || data[bit >> 3] != good) {
+                printf("ECC: bit %lu of page %lu not corrected (%d)\n", bit, n, ret);
+                missed++;
+            }
+            flips++;
+        }
+    }
+
+    printf("ECC: %lu pages, %lu mismatches\n", pages, mismatches);
+    printf("ECC: %lu single bit flips, %lu not corrected\n", flips, missed);
+    printf("ECC: reference %lu us, fast %lu us\n", ticks_ref * 10 / 19, ticks_fast * 10 / 19);
+    return (mismatches || missed) ? -1 : 0;
+}
+#endif // MINUTE_BOOT1
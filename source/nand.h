@@ -38,6 +38,26 @@
 #define CLUSTER_SIZE        (PAGE_SIZE * CLUSTER_PAGES)
 #define CLUSTER_COUNT       (PAGE_COUNT / CLUSTER_PAGES)
 
+/* Sparse raw image (SLC.RAW): a header with a bitmap of the stored blocks, followed by
+   the pages and spare of those blocks only. Blocks that are not stored are fully erased. */
+#define NAND_RAW_PAGE_STRIDE    (PAGE_SIZE + PAGE_SPARE_SIZE)
+#define NAND_RAW_BLOCK_SIZE     (BLOCK_PAGES * NAND_RAW_PAGE_STRIDE)
+#define NAND_SPARSE_MAGIC       (0x53524157) // SRAW
+#define NAND_SPARSE_VERSION     1
+#define NAND_SPARSE_BLOCKS      (NAND_MAX_PAGE / BLOCK_PAGES)
+#define NAND_SPARSE_HDR_SIZE    0x400 // keeps the blocks sector aligned
+#define NAND_SPARSE_ERASED      0xFFFF
+
+typedef struct {
+    u32 magic;
+    u32 version;
+    u32 total_pages;
+    u32 stored_blocks;
+    u8 bitmap[NAND_SPARSE_BLOCKS / 8]; // bit set if the block is stored
+    u8 pad[NAND_SPARSE_HDR_SIZE - 0x10 - NAND_SPARSE_BLOCKS / 8];
+} PACKED nand_sparse_hdr;
+_Static_assert(sizeof(nand_sparse_hdr) == NAND_SPARSE_HDR_SIZE, "nand_sparse_hdr size must be 0x400!");
+
 void nand_irq(void);
 
 void nand_send_command(u32 command, u32 bitmask, u32 flags, u32 num_bytes);
@@ -45,6 +65,8 @@ int nand_reset(u32 bank);
 void nand_get_id(u8 *);
 void nand_get_status(u8 *);
 int nand_read_page(u32 pageno, void *data, void *ecc);
+int nand_start_read_page(u32 pageno, void *data, void *ecc);
+int nand_end_read_page(void);
 int nand_write_page_raw(u32 pageno, void *data, void *ecc);
 int nand_write_page(u32 pageno, void *data, void *ecc);
 int nand_erase_block(u32 pageno);
@@ -56,7 +78,9 @@ void nand_wait(void);
 
 int nand_correct(u32 pageno, void *data, void *ecc);
 void nand_initialize(u32 bank);
+u32 nand_get_program_count(void);
 void nand_create_ecc(void* in_data, void* spare_out);
+int nand_ecc_test(u32 pages);
 
 #endif
 
@@ -45,6 +45,8 @@ struct sdcard_ctx {
     int selected;
     int new_card; // set to 1 everytime a new card is inserted
     int multiple_fallback;
+    int scr_read;
+    int cmd23; // SCR says SET_BLOCK_COUNT works
 
     u32 num_sectors;
     u16 rca;
@@ -558,6 +560,16 @@ int sdcard_end_read(struct sdmmc_command* cmdbuf)
     return 0;
 }
 
+int sdcard_async_done(struct sdmmc_command* cmdbuf)
+{
+    return sdhc_async_done(card.handle, cmdbuf);
+}
+
+u32 sdcard_max_blocks(void)
+{
+    return sdhc_max_blocks(card.handle);
+}
+
 int sdcard_read(u32 blk_start, u32 blk_count, void *data)
 {
     struct sdmmc_command cmd;
@@ -596,7 +608,7 @@ retry_single:
     }
 
     while(blk_count){
-        u32 cmd_blk_count = min(blk_count, SDHC_BLOCK_COUNT_MAX);
+        u32 cmd_blk_count = min(blk_count, sdhc_max_blocks(card.handle));
         memset(&cmd, 0, sizeof(cmd));
 
         if(blk_count > 1) {
@@ -618,6 +630,10 @@ retry_single:
 
         if (cmd.c_error) {
             printf("sdcard: MMC_READ_BLOCK_%s failed with %d\n", blk_count > 1 ? "MULTIPLE" : "SINGLE", cmd.c_error);
+            if (sdhc_adma_failed(card.handle)) {
+                printf("sdcard: retrying over SDMA\n");
+                continue;
+            }
             if (blk_count > 1 && !card.multiple_fallback) {
                 printf("sdcard: trying only single blocks?\n");
                 card.multiple_fallback = 1;
@@ -651,6 +667,84 @@ retry_single:
 }
 
 #ifndef LOADER
+static int _sdcard_app_cmd(void)
+{
+    struct sdmmc_command cmd;
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.c_opcode = MMC_APP_CMD;
+    cmd.c_arg = ((u32)card.rca)<<16;
+    cmd.c_flags = SCF_RSP_R1;
+    sdhc_exec_command(card.handle, &cmd);
+    return cmd.c_error;
+}
+
+static int _sdcard_supports_cmd23(void)
+{
+    // the invalidate covers whole cache lines, keep the buffer to itself
+    static u8 scr[32] ALIGNED(32);
+    struct sdmmc_command cmd;
+
+    if (card.scr_read)
+        return card.cmd23;
+    card.scr_read = 1;
+
+    if (_sdcard_app_cmd())
+        return 0;
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.c_opcode = SD_APP_SEND_SCR;
+    cmd.c_data = scr;
+    cmd.c_datalen = 8;
+    cmd.c_blklen = 8;
+    cmd.c_flags = SCF_RSP_R1 | SCF_CMD_ADTC | SCF_CMD_READ;
+    sdhc_exec_command(card.handle, &cmd);
+    if (cmd.c_error) {
+        printf("sdcard: SD_APP_SEND_SCR failed with %d\n", cmd.c_error);
+        return 0;
+    }
+
+    // CMD_SUPPORT, SCR bit 33
+    card.cmd23 = (scr[3] & 0x02) != 0;
+    DPRINTF(1, ("sdcard: CMD23 %ssupported\n", card.cmd23 ? "" : "not "));
+    return card.cmd23;
+}
+
+/*
+ * Tells the card how many blocks the next write multiple carries. With CMD23 the
+ * transfer ends by itself and SCF_NO_STOP is returned for the write command,
+ * otherwise ACMD23 lets the card pre-erase and the host sends CMD12 as usual.
+ * Only streams use this, the extra command only pays off for long sequential writes.
+ */
+static int _sdcard_announce_write(u32 blk_count)
+{
+    struct sdmmc_command cmd;
+
+    if (blk_count <= 1)
+        return 0;
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.c_flags = SCF_RSP_R1;
+    if (_sdcard_supports_cmd23()) {
+        cmd.c_opcode = MMC_SET_BLOCK_COUNT;
+        cmd.c_arg = blk_count;
+        sdhc_exec_command(card.handle, &cmd);
+        if (!cmd.c_error)
+            return SCF_NO_STOP;
+        printf("sdcard: MMC_SET_BLOCK_COUNT failed with %d\n", cmd.c_error);
+        card.cmd23 = 0;
+        return 0;
+    }
+
+    // only a hint, the write works without it
+    if (_sdcard_app_cmd())
+        return 0;
+    cmd.c_opcode = SD_APP_SET_WR_BLK_ERASE_COUNT;
+    cmd.c_arg = blk_count & 0x7FFFFF;
+    sdhc_exec_command(card.handle, &cmd);
+    return 0;
+}
+
 int sdcard_start_write(u32 blk_start, u32 blk_count, void *data, struct sdmmc_command* cmdbuf)
 {
     if (card.inserted == 0) {
@@ -776,7 +870,7 @@ retry_single:
     }
 
     while(blk_count){
-        u32 cmd_blk_count = min(blk_count, SDHC_BLOCK_COUNT_MAX);
+        u32 cmd_blk_count = min(blk_count, sdhc_max_blocks(card.handle));
         memset(&cmd, 0, sizeof(cmd));
 
         if(blk_count > 1) {
@@ -798,6 +892,10 @@ retry_single:
 
         if (cmd.c_error) {
             printf("sdcard: MMC_WRITE_BLOCK_%s failed with %d\n", blk_count > 1 ? "MULTIPLE" : "SINGLE", cmd.c_error);
+            if (sdhc_adma_failed(card.handle)) {
+                printf("sdcard: retrying over SDMA\n");
+                continue;
+            }
             if (blk_count > 1 && !card.multiple_fallback) {
                 printf("sdcard: trying only single blocks?\n");
                 card.multiple_fallback = 1;
@@ -826,6 +924,120 @@ retry_single:
     return 0;
 }
 
+int sdcard_stream_open(sdcard_stream* stream, u32 blk_start, u32 blk_count)
+{
+    memset(stream, 0, sizeof(*stream));
+
+    if (card.inserted == 0) {
+        printf("sdcard: STREAM: no card inserted.\n");
+        return -1;
+    }
+
+    if (card.new_card == 1) {
+        printf("sdcard: new card inserted but not acknowledged yet.\n");
+        return -1;
+    }
+
+    if (card.selected == 0 && sdcard_select() < 0) {
+        printf("sdcard: STREAM: cannot select card.\n");
+        return -1;
+    }
+
+    if (blk_start + blk_count > card.num_sectors || blk_start + blk_count < blk_start) {
+        printf("sdcard: STREAM: 0x%08lx+0x%lx is past the end of the card\n", blk_start, blk_count);
+        return -1;
+    }
+
+    // read the SCR now rather than in the middle of the first write
+    _sdcard_supports_cmd23();
+
+    stream->next = blk_start;
+    stream->end = blk_start + blk_count;
+    stream->start_tick = read32(LT_TIMER);
+    return 0;
+}
+
+/*
+ * Writes the next blk_count blocks of the stream. Each write multiple is
+ * announced with its exact block count, see _sdcard_announce_write(). On
+ * failure nothing counts as written, so the same call can be retried.
+ */
+int sdcard_stream_write(sdcard_stream* stream, void* data, u32 blk_count)
+{
+    struct sdmmc_command cmd;
+    u32 blk_start = stream->next;
+    u32 left = blk_count;
+    u32 commands = 0;
+    u8* buf = data;
+
+    if (blk_count > stream->end - stream->next) {
+        printf("sdcard: STREAM: write of 0x%lx blocks at 0x%08lx overruns the stream\n",
+               blk_count, stream->next);
+        return -1;
+    }
+
+    while (left) {
+        u32 cmd_blk_count = min(left, sdcard_max_blocks());
+
+        // single blocks and fallbacks are the plain path's business
+        if (cmd_blk_count <= 1 || card.multiple_fallback || !can_sdcard_dma_addr(buf))
+            break;
+
+        int flags = _sdcard_announce_write(cmd_blk_count);
+        memset(&cmd, 0, sizeof(cmd));
+        cmd.c_opcode = MMC_WRITE_BLOCK_MULTIPLE;
+        if (card.sdhc_blockmode)
+            cmd.c_arg = blk_start;
+        else
+            cmd.c_arg = blk_start * SDMMC_DEFAULT_BLOCKLEN;
+        cmd.c_data = buf;
+        cmd.c_datalen = cmd_blk_count * SDMMC_DEFAULT_BLOCKLEN;
+        cmd.c_blklen = SDMMC_DEFAULT_BLOCKLEN;
+        cmd.c_flags = SCF_RSP_R1 | flags;
+        sdhc_exec_command(card.handle, &cmd);
+
+        if (cmd.c_error) {
+            printf("sdcard: STREAM: MMC_WRITE_BLOCK_MULTIPLE failed with %d\n", cmd.c_error);
+            break;
+        } else if (MMC_R1(cmd.c_resp) & MMC_R1_ANY_ERROR) {
+            printf("sdcard: write reported error. status: %08lx\n", MMC_R1(cmd.c_resp));
+            return -2;
+        }
+
+        commands++;
+        left -= cmd_blk_count;
+        blk_start += cmd_blk_count;
+        buf += cmd.c_datalen;
+    }
+
+    if (left) {
+        int res = sdcard_write(blk_start, left, buf);
+        if (res)
+            return res;
+
+        u32 max = card.multiple_fallback ? 1 : sdcard_max_blocks();
+        commands += (left + max - 1) / max;
+    }
+
+    stream->commands += commands;
+    stream->next += blk_count;
+    stream->written += blk_count;
+    return 0;
+}
+
+void sdcard_stream_close(sdcard_stream* stream, const char* name)
+{
+    u32 ticks = read32(LT_TIMER) - stream->start_tick;
+    if (!ticks)
+        ticks = 1;
+
+    // LT_TIMER runs at 1.9MHz
+    u32 tenths = (u32)(((u64)stream->written * SDMMC_DEFAULT_BLOCKLEN * 19) / ticks);
+    printf("%s: %lu MiB in %lus, %lu.%lu MB/s, %lu commands%s\n", name ? name : "sdcard",
+           stream->written / 2048, ticks / 1900000, tenths / 10, tenths % 10,
+           stream->commands, card.cmd23 ? " (CMD23)" : "");
+}
+
 int sdcard_wait_data(void)
 {
     struct sdmmc_command cmd;
@@ -877,6 +1089,9 @@ void sdcard_init(void)
         .abort = &sdcard_abort,
         .rb = RB_SD0,
         .wb = WB_SD0,
+#ifdef CAN_HAZ_IRQ
+        .irq = 1,
+#endif
     };
 
 #ifdef CAN_HAZ_IRQ
@@ -38,4 +38,20 @@ int sdcard_end_read(struct sdmmc_command* cmdbuf);
 int sdcard_start_write(u32 blk_start, u32 blk_count, void *data, struct sdmmc_command* cmdbuf);
 int sdcard_end_write(struct sdmmc_command* cmdbuf);
 
+int sdcard_async_done(struct sdmmc_command* cmdbuf);
+u32 sdcard_max_blocks(void); // per command, 256 without ADMA
+
+// sequential write session over a fixed range of sectors
+typedef struct {
+    u32 next;
+    u32 end;
+    u32 start_tick;
+    u32 written;
+    u32 commands;
+} sdcard_stream;
+
+int sdcard_stream_open(sdcard_stream* stream, u32 blk_start, u32 blk_count);
+int sdcard_stream_write(sdcard_stream* stream, void* data, u32 blk_count);
+void sdcard_stream_close(sdcard_stream* stream, const char* name);
+
 #endif
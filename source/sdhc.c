@@ -28,10 +28,9 @@
 #include "memory.h"
 #include "utils.h"
 #include "gpio.h"
+#include "latte.h"
 
-#ifdef CAN_HAZ_IRQ
 #include "irq.h"
-#endif
 
 //#define SDHC_DEBUG
 
@@ -95,6 +94,7 @@ static inline void bus_space_write_1(bus_space_handle_t ioh, u32 r, u8 v)
 
 /* flag values */
 #define SHF_USE_DMA     0x0001
+#define SHF_USE_ADMA2   0x0002
 
 #define HREAD1(hp, reg)                         \
     (bus_space_read_1((hp)->ioh, (reg)))
@@ -182,6 +182,12 @@ sdhc_host_found(struct sdhc_host *hp, struct sdhc_host_params *pa, bus_space_tag
     /* Use DMA if the host system and the controller support it. */
     if (usedma && ISSET(caps, SDHC_DMA_SUPPORT))
         SET(hp->flags, SHF_USE_DMA);
+#ifndef MINUTE_BOOT1
+    /* Prefer ADMA2, no boundary stops and no 256 block limit. */
+    if (ISSET(hp->flags, SHF_USE_DMA) && ISSET(caps, SDHC_ADMA2_SUPPORT) &&
+        SDHC_SPEC_VERSION(hp->version) >= SDHC_SPEC_V2)
+        SET(hp->flags, SHF_USE_ADMA2);
+#endif
 
     /*
      * Determine the base clock frequency. (2.2.24)
@@ -542,12 +548,20 @@ sdhc_async_command(struct sdhc_host *hp, struct sdmmc_command *cmd)
             cmd->c_timeout = SDHC_COMMAND_TIMEOUT;
     }
 
+    /*
+     * A late interrupt for the previous command must not land between
+     * the clear and the start and satisfy this command's wait.
+     */
+    u32 cookie = irq_kill();
     hp->intr_status = 0;
+    hp->intr_error_status = 0;
+    hp->adma_failed = 0;
 
     /*
      * Start the MMC command, or mark `cmd' as failed and return.
      */
     error = sdhc_start_command(hp, cmd);
+    irq_restore(cookie);
     if (error != 0) {
         cmd->c_error = error;
         SET(cmd->c_flags, SCF_ITSDONE);
@@ -617,27 +631,144 @@ sdhc_async_response(struct sdhc_host *hp, struct sdmmc_command *cmd)
     hp->data_command = 0;
 }
 
-void
-sdhc_exec_command(struct sdhc_host *hp, struct sdmmc_command *cmd)
+/*
+ * Completion is signalled by the host interrupt (sdcard_irq()/mlc_irq())
+ * unless it isn't wired up, IRQs are masked or we are the IRQ handler;
+ * then sdhc_intr() has to be polled.
+ */
+static inline int
+sdhc_irq_driven(struct sdhc_host *hp)
 {
 #ifdef CAN_HAZ_IRQ
-    u32 cookie = irq_kill();
+    u32 cpsr = get_cpsr();
+    return hp->pa.irq && (cpsr & 0b11111) != 0b10010 && !(cpsr & CPSR_IRQDIS);
+#else
+    (void) hp;
+    return 0;
+#endif
+}
+
+static inline int
+sdhc_cmd_dma(struct sdhc_host *hp, struct sdmmc_command *cmd)
+{
+    if (hp->no_dma || !ISSET(hp->flags, SHF_USE_DMA))
+        return 0;
+    return can_sdcard_dma_addr(cmd->c_data);
+}
+
+static inline int
+sdhc_cmd_adma(struct sdhc_host *hp, struct sdmmc_command *cmd)
+{
+    return ISSET(hp->flags, SHF_USE_ADMA2) && sdhc_cmd_dma(hp, cmd);
+}
+
+u_int32_t
+sdhc_max_blocks(struct sdhc_host *hp)
+{
+    if (!hp->no_dma && ISSET(hp->flags, SHF_USE_ADMA2))
+        return SDHC_ADMA_BLOCK_COUNT_MAX;
+    return SDHC_BLOCK_COUNT_MAX;
+}
+
+/*
+ * Returns (once) whether the last command failed because ADMA2 had to be turned
+ * off. Such a command is worth one retry over SDMA, split to the smaller
+ * sdhc_max_blocks(), before the caller's own fallbacks kick in.
+ */
+int
+sdhc_adma_failed(struct sdhc_host *hp)
+{
+    int failed = hp->adma_failed;
+    hp->adma_failed = 0;
+    return failed;
+}
+
+#ifndef MINUTE_BOOT1
+/*
+ * The controller fetches descriptors through the same little endian DMA
+ * path as the data, so they are stored byte swapped.
+ */
+static inline u_int32_t
+sdhc_adma_le32(u_int32_t v)
+{
+    return __builtin_bswap32(v);
+}
+
+/* Describe the command's buffer in the host's ADMA2 table. */
+static int
+sdhc_adma_setup(struct sdhc_host *hp, struct sdmmc_command *cmd)
+{
+    u_char *addr = cmd->c_data;
+    u_int32_t len = cmd->c_datalen;
+    u_int32_t *desc = hp->adma_desc;
+    int n = 0;
+
+    if (!can_sdcard_dma_addr(addr) || (len & 3))
+        return EINVAL;
+
+    while (len) {
+        u_int32_t chunk = MIN(len, SDHC_ADMA_DESC_MAX_LEN);
+        if (n == SDHC_ADMA_DESC_COUNT)
+            return EINVAL;
+        desc[n * 2] = sdhc_adma_le32((chunk << 16) | SDHC_ADMA_ACT_TRAN | SDHC_ADMA_VALID);
+        desc[n * 2 + 1] = sdhc_adma_le32((u32)addr);
+        addr += chunk;
+        len -= chunk;
+        n++;
+    }
+    if (n == 0)
+        return EINVAL;
+    desc[(n - 1) * 2] |= sdhc_adma_le32(SDHC_ADMA_END);
+
+    dc_flushrange(desc, n * 2 * sizeof(u_int32_t));
+    HWRITE4(hp, SDHC_ADMA_SYSTEM_ADDR, (u32)desc);
+    return 0;
+}
 #endif
+
+/*
+ * Non-blocking check whether a command started with sdhc_async_command()
+ * has finished (or failed), so sdhc_async_response() won't have to wait.
+ */
+int
+sdhc_async_done(struct sdhc_host *hp, struct sdmmc_command *cmd)
+{
+    int mask = SDHC_ERROR_INTERRUPT | SDHC_ERROR_TIMEOUT;
+
+    if (ISSET(cmd->c_flags, SCF_ITSDONE))
+        return 1;
+
+    if (!sdhc_irq_driven(hp)) {
+        u32 cookie = irq_kill();
+        sdhc_intr(hp);
+        irq_restore(cookie);
+    }
+
+    /* PIO transfers only start once the response has been collected */
+    if (cmd->c_datalen > 0 && sdhc_cmd_dma(hp, cmd))
+        mask |= SDHC_TRANSFER_COMPLETE;
+    else
+        mask |= SDHC_COMMAND_COMPLETE;
+
+    return ISSET(hp->intr_status, mask) ? 1 : 0;
+}
+
+void
+sdhc_exec_command(struct sdhc_host *hp, struct sdmmc_command *cmd)
+{
     //serial_send_u32(0x1234AAAA);
     sdhc_async_command(hp, cmd);
     //serial_send_u32(0x1234AAAB);
     sdhc_async_response(hp, cmd);
     //serial_send_u32(0x1234AAAD);
-#ifdef CAN_HAZ_IRQ
-    irq_restore(cookie);
-#endif
 }
 
 int
 sdhc_start_command(struct sdhc_host *hp, struct sdmmc_command *cmd)
 {
     u_int16_t blksize = 0;
-    u_int16_t blkcount = 0;
+    u_int32_t blkcount = 0;
+    u_int32_t blkmax = SDHC_BLOCK_COUNT_MAX;
     u_int16_t mode;
     u_int16_t command;
     int error;
@@ -662,7 +793,9 @@ sdhc_start_command(struct sdhc_host *hp, struct sdmmc_command *cmd)
     }
 
     /* Check limit imposed by 9-bit block count. (1.7.2) */
-    if (blkcount > SDHC_BLOCK_COUNT_MAX) {
+    if (sdhc_cmd_adma(hp, cmd))
+        blkmax = SDHC_ADMA_BLOCK_COUNT_MAX;
+    if (blkcount > blkmax) {
         printf("sdhc: too much data\n");
         return EINVAL;
     }
@@ -676,10 +809,11 @@ sdhc_start_command(struct sdhc_host *hp, struct sdmmc_command *cmd)
         if (blkcount > 1) {
             mode |= SDHC_MULTI_BLOCK_MODE;
             /* XXX only for memory commands? */
-            mode |= SDHC_AUTO_CMD12_ENABLE;
+            if (!ISSET(cmd->c_flags, SCF_NO_STOP))
+                mode |= SDHC_AUTO_CMD12_ENABLE;
         }
     }
-    if (!hp->no_dma && can_sdcard_dma_addr(cmd->c_data) && ISSET(hp->flags, SHF_USE_DMA))
+    if (sdhc_cmd_dma(hp, cmd))
         mode |= SDHC_DMA_ENABLE;
 
     /*
@@ -711,16 +845,28 @@ sdhc_start_command(struct sdhc_host *hp, struct sdmmc_command *cmd)
 
     if ((mode & SDHC_DMA_ENABLE) && cmd->c_datalen > 0) 
     {
+        u_int8_t hostctl = HREAD1(hp, SDHC_HOST_CTL) & ~SDHC_DMA_SELECT_MASK;
+
         cmd->c_resid = blkcount;
         cmd->c_buf = cmd->c_data;
 
-        if (ISSET(cmd->c_flags, SCF_CMD_READ)) {
+        if (ISSET(cmd->c_flags, SCF_CMD_READ))
             dc_invalidaterange(cmd->c_data, cmd->c_datalen);
-        } else {
+        else
             dc_flushrange(cmd->c_data, cmd->c_datalen);
-            ahb_flush_to(hp->pa.rb);
-        }
-        HWRITE4(hp, SDHC_DMA_ADDR, (u32)cmd->c_data);
+
+#ifndef MINUTE_BOOT1
+        if (sdhc_cmd_adma(hp, cmd)) {
+            if ((error = sdhc_adma_setup(hp, cmd)) != 0)
+                return error;
+            hostctl |= SDHC_DMA_SELECT_ADMA2;
+        } else
+#endif
+            HWRITE4(hp, SDHC_DMA_ADDR, (u32)cmd->c_data);
+
+        /* the table was flushed above too */
+        ahb_flush_to(hp->pa.rb);
+        HWRITE1(hp, SDHC_HOST_CTL, hostctl);
     }
 
     DPRINTF(1,("sdhc: cmd=%#x mode=%#x blksize=%d blkcount=%d\n",
@@ -749,7 +895,7 @@ sdhc_transfer_data(struct sdhc_host *hp, struct sdmmc_command *cmd)
     error = 0;
 
     DPRINTF(1,("resp=%#x datalen=%d\n", MMC_R1(cmd->c_resp), cmd->c_datalen));
-    if (!hp->no_dma && can_sdcard_dma_addr(cmd->c_data) && ISSET(hp->flags, SHF_USE_DMA)) {
+    if (sdhc_cmd_dma(hp, cmd)) {
         for(;;) {
             status = sdhc_wait_intr(hp, SDHC_TRANSFER_COMPLETE |
                     SDHC_DMA_INTERRUPT,
@@ -847,34 +993,44 @@ sdhc_wait_intr_debug(const char *funcname, int line, struct sdhc_host *hp, int m
     (void) line;
 
     int status;
+    int irq_driven = sdhc_irq_driven(hp);
+    u32 start = read32(LT_TIMER);
+    u32 deadline = (u32)timo * 1900;
+    u32 elapsed;
+    u32 cookie;
 
     mask |= SDHC_ERROR_INTERRUPT;
     mask |= SDHC_ERROR_TIMEOUT;
 
-    status = hp->intr_status & mask;
-
-    for (; timo > 0; timo--) {
-        for (int j = 0; j < 1000; j++)
-        {
-#ifdef CAN_HAZ_IRQ
-            if((get_cpsr() & 0b11111) == 0b10010 || (get_cpsr() & 0b11111) == 0b11111)
-#endif
-                sdhc_intr(hp); // seems backwards but ok
-
-            if (hp->intr_status != 0) {
-                status = hp->intr_status & mask;
-                goto breakout;
-            }
+    /* timo is in milliseconds, LT_TIMER runs at 1.9MHz */
+    for (;;) {
+        cookie = irq_kill();
+        if (!irq_driven)
+            sdhc_intr(hp);
 
-            udelay(1);
+        if (hp->intr_status != 0) {
+            status = hp->intr_status & mask;
+            break;
+        }
+        elapsed = read32(LT_TIMER) - start;
+        if (elapsed >= deadline) {
+            // the interrupt may have been lost, look at the registers once more
+            if (irq_driven)
+                sdhc_intr(hp);
+            status = hp->intr_status & mask;
+            if (hp->intr_status == 0)
+                status |= SDHC_ERROR_TIMEOUT;
+            break;
         }
-    }
-breakout:
 
-    if (timo == 0) {
-        status |= SDHC_ERROR_TIMEOUT;
+        // power-saving IRQ wait, the handler runs once IRQs are restored,
+        // the alarm makes sure we get back here by the deadline
+        if (irq_driven)
+            irq_wait_ticks(deadline - elapsed);
+        irq_restore(cookie);
     }
     hp->intr_status &= ~status;
+    irq_restore(cookie);
 
     DPRINTF(2,("sdhc: funcname=%s, line=%d, timo=%d status=%#x intr status=%#x error %#x\n",
         funcname, line, timo, status, hp->intr_status, hp->intr_error_status));
@@ -943,8 +1099,14 @@ sdhc_intr(struct sdhc_host *hp)
 
         DPRINTF(2,("sdhc: error interrupt, status=0x%x, signal=0x%x\n", error, signal));
 
+        if (ISSET(error, SDHC_ADMA_ERROR)) {
+            printf("sdhc: ADMA error %x, using SDMA from now on\n", HREAD1(hp, SDHC_ADMA_ERROR_STATUS));
+            hp->flags &= ~SHF_USE_ADMA2;
+            hp->adma_failed = 1;
+        }
+
         if (ISSET(error, SDHC_CMD_TIMEOUT_ERROR|
-            SDHC_DATA_TIMEOUT_ERROR)) {
+            SDHC_DATA_TIMEOUT_ERROR|SDHC_ADMA_ERROR)) {
             hp->intr_error_status |= error;
             hp->intr_status |= status;
         }
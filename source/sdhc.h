@@ -30,8 +30,16 @@ struct sdhc_host_params {
     void (*abort)();
     enum rb_client rb;
     enum wb_client wb;
+    int irq;    /* host interrupt calls sdhc_intr(), waits can sleep */
 };
 
+/* ADMA2 descriptor table, one table per host covers a whole command */
+#define SDHC_ADMA_DESC_COUNT        128
+#define SDHC_ADMA_DESC_MAX_LEN      0x8000
+#define SDHC_ADMA_VALID             (1<<0)
+#define SDHC_ADMA_END               (1<<1)
+#define SDHC_ADMA_ACT_TRAN          (2<<4)
+
 struct sdhc_host {
     bus_space_tag_t iot;        /* host register set tag */
     bus_space_handle_t ioh;     /* host register set handle */
@@ -44,8 +52,12 @@ struct sdhc_host {
     volatile u_int16_t intr_error_status;    /* soft error status */
     int data_command;
     int no_dma;
+    int adma_failed;    /* ADMA2 was just turned off, see sdhc_adma_failed() */
 
     struct sdhc_host_params pa;
+#ifndef MINUTE_BOOT1
+    u_int32_t adma_desc[SDHC_ADMA_DESC_COUNT * 2] ALIGNED(32);
+#endif
 };
 
 /* Host controller functions called by the attachment driver. */
@@ -63,6 +75,8 @@ int sdhc_intr(struct sdhc_host *);
 #else
 #define SDHC_BLOCK_COUNT_MAX        256
 #endif
+/* with ADMA2 only the descriptor table limits a command (4MiB) */
+#define SDHC_ADMA_BLOCK_COUNT_MAX   (SDHC_ADMA_DESC_COUNT * SDHC_ADMA_DESC_MAX_LEN / 512)
 #define SDHC_ARGUMENT           0x08
 #define SDHC_TRANSFER_MODE      0x0c
 #define SDHC_MULTI_BLOCK_MODE       (1<<5)
@@ -110,6 +124,9 @@ int sdhc_intr(struct sdhc_host *);
 #define SDHC_CMD_INHIBIT_CMD        (1<<0)
 #define SDHC_CMD_INHIBIT_MASK       0x0003
 #define SDHC_HOST_CTL           0x28
+#define SDHC_DMA_SELECT_MASK        (3<<3)
+#define SDHC_DMA_SELECT_SDMA        (0<<3)
+#define SDHC_DMA_SELECT_ADMA2       (2<<3)
 #define SDHC_8BIT_MODE          (1<<5)
 #define SDHC_HIGH_SPEED         (1<<2)
 #define SDHC_4BIT_MODE          (1<<1)
@@ -178,6 +195,7 @@ int sdhc_intr(struct sdhc_host *);
 #define SDHC_VOLTAGE_SUPP_3_3V      (1<<24)
 #define SDHC_DMA_SUPPORT        (1<<22)
 #define SDHC_HIGH_SPEED_SUPP        (1<<21)
+#define SDHC_ADMA2_SUPPORT      (1<<19)
 #define SDHC_BASE_FREQ_SHIFT        8
 #define SDHC_BASE_FREQ_MASK     0x3f
 #define SDHC_BASE_FREQ_MASK_V3      0xff
@@ -185,6 +203,8 @@ int sdhc_intr(struct sdhc_host *);
 #define SDHC_TIMEOUT_FREQ_SHIFT     0
 #define SDHC_TIMEOUT_FREQ_MASK      0x1f
 #define SDHC_MAX_CAPABILITIES       0x48
+#define SDHC_ADMA_ERROR_STATUS      0x54
+#define SDHC_ADMA_SYSTEM_ADDR       0x58
 #define SDHC_SLOT_INTR_STATUS       0xfc
 #define SDHC_HOST_CTL_VERSION       0xfe
 #define SDHC_SPEC_VERS_SHIFT        0
@@ -234,5 +254,9 @@ void sdhc_exec_command(struct sdhc_host *hp, struct sdmmc_command *);
 
 void sdhc_async_command(struct sdhc_host *hp, struct sdmmc_command *);
 void sdhc_async_response(struct sdhc_host *hp, struct sdmmc_command *);
+int sdhc_async_done(struct sdhc_host *hp, struct sdmmc_command *);
+
+u_int32_t sdhc_max_blocks(struct sdhc_host *hp);
+int sdhc_adma_failed(struct sdhc_host *hp);
 
 #endif
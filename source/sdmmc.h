@@ -77,6 +77,7 @@ struct sdmmc_command {
     int      c_blklen;  /* block length */
     int      c_flags;   /* see below */
 #define SCF_ITSDONE  0x0001     /* command is complete */
+#define SCF_NO_STOP  0x0002     /* block count preset with CMD23, no auto CMD12 */
 #define SCF_CMD(flags)   ((flags) & 0x00f0)
 #define SCF_CMD_AC   0x0000
 #define SCF_CMD_ADTC     0x0010
@@ -191,7 +192,9 @@ struct sdmmc_function {
 
 /* SD application commands */           /* response type */
 #define SD_APP_SET_BUS_WIDTH        6   /* R1 */
+#define SD_APP_SET_WR_BLK_ERASE_COUNT 23 /* R1 */
 #define SD_APP_OP_COND          41  /* R3 */
+#define SD_APP_SEND_SCR         51  /* R1 */
 
 /* OCR bits */
 #define MMC_OCR_MEM_READY       (1<<31) /* memory power-up status bit */
@@ -272,6 +275,8 @@ struct sdmmc_function {
 #define MMC_CSD_CAPACITY(resp)      ((MMC_CSD_C_SIZE((resp))+1) << \
                      (MMC_CSD_C_SIZE_MULT((resp))+2))
 #define MMC_CSD_C_SIZE_MULT(resp)   MMC_RSP_BITS((resp), 47, 3)
+#define MMC_CSD_ERASE_GRP_SIZE(resp) MMC_RSP_BITS((resp), 42, 5) /* +1 */
+#define MMC_CSD_ERASE_GRP_MULT(resp) MMC_RSP_BITS((resp), 37, 5) /* +1 */
 
 /* MMC v1 R2 response (CID) */
 #define MMC_CID_MID_V1(resp)        MMC_RSP_BITS((resp), 104, 24)
@@ -12,11 +12,14 @@
 #include "gpio.h"
 #include "utils.h"
 #include "gfx.h"
+#include "log.h"
+#include "irq.h"
 #include <string.h>
 
 u8 serial_buffer[256];
 u16 serial_len = 0;
 static u8 _serial_allow_zeros = 0;
+static volatile u8 _serial_busy = 0;
 u32 serial_line = 0;
 
 void serial_fatal()
@@ -75,12 +78,15 @@ void serial_send_u32(u32 val)
 
 int serial_in_read(u8* out) {
     memset(out, 0, sizeof(serial_buffer));
-    memcpy(out, serial_buffer, serial_len);
-    out[255] = 0;
 
+    // the log drain sends from the timer IRQ and captures input as it goes
+    u32 cookie = irq_kill();
     u16 read_len = serial_len;
+    memcpy(out, serial_buffer, read_len);
     serial_len = 0;
+    irq_restore(cookie);
 
+    out[255] = 0;
     return read_len;
 }
 
@@ -98,6 +104,7 @@ void serial_line_noscroll()
 void serial_clear()
 {
     static int saved = 0;
+    log_flush();
     int get_serial_line = serial_line;
 
     if (!saved) {
@@ -122,8 +129,10 @@ void serial_clear()
     serial_line = 0;
 }
 
+// menus poll for input, which makes this a good point to drain the log
 void serial_poll()
 {
+    log_idle();
     serial_send(0);
 }
 
@@ -137,10 +146,17 @@ void serial_disallow_zeros()
     _serial_allow_zeros = 0;
 }
 
+// a byte is being clocked out, the log drain in the timer IRQ must not start another one
+u8 serial_busy()
+{
+    return _serial_busy;
+}
+
 void serial_send(u8 val)
 {
     u8 read_val = 0;
     u8 read_val_valid = 0;
+    _serial_busy = 1;
     for (int j = 7; j >= 0; j--)
     {
         u8 bit = (val & (1<<j)) ? 1 : 0;
@@ -162,4 +178,5 @@ void serial_send(u8 val)
     }
 
     serial_force_terminate();
+    _serial_busy = 0;
 }
\ No newline at end of file
@@ -20,6 +20,7 @@ void serial_poll();
 void serial_allow_zeros();
 void serial_disallow_zeros();
 void serial_send(u8 val);
+u8 serial_busy();
 void serial_line_inc();
 void serial_clear();
 void serial_line_noscroll();
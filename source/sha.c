@@ -17,51 +17,132 @@ A million repetitions of "a"
 #include <string.h>
 #include <stdlib.h>
 #include <malloc.h>
+#include <stdio.h>
 
 #include "sha.h"
 #include "irq.h"
 #include "memory.h"
 #include "latte.h"
 
-//should be divisible by four
-#define BLOCKSIZE 32
-
 #define SHA_CMD_FLAG_EXEC (1<<31)
 #define SHA_CMD_FLAG_IRQ  (1<<30)
 #define SHA_CMD_FLAG_ERR  (1<<29)
 #define SHA_CMD_AREA_BLOCK ((1<<10) - 1)
 
-static void sha_transform(u32 state[SHA_HASH_WORDS], u8 buffer[SHA_BLOCK_SIZE], u32 blocks)
-{
-    if(blocks == 0) return;
+// the engine reads aligned buffers in place, everything else goes through the staging buffer
+#define SHA_DMA_ALIGN       (64)
+#define SHA_MAX_BLOCKS      (SHA_CMD_AREA_BLOCK + 1)
+#define SHA_STAGING_BLOCKS  (32)
 
-    /* Copy ctx->state[] to working vars */
-    write32(SHA_H0, state[0]);
-    write32(SHA_H1, state[1]);
-    write32(SHA_H2, state[2]);
-    write32(SHA_H3, state[3]);
-    write32(SHA_H4, state[4]);
+static u8 sha_staging[SHA_BLOCK_SIZE * SHA_STAGING_BLOCKS] ALIGNED(128);
 
-    // assign block to local copy which is 64-byte aligned
-    u8 *block = memalign(128, SHA_BLOCK_SIZE * blocks);
-    memcpy(block, buffer, SHA_BLOCK_SIZE * blocks);
+#ifndef MINUTE_BOOT1
+// benchmark switch, copies every block through the heap like the old driver did
+static bool sha_legacy_copy = false;
+#endif
 
+static void _sha_run(const u8* src, u32 blocks)
+{
     // royal flush :)
-    dc_flushrange(block, SHA_BLOCK_SIZE * blocks);
+    dc_flushrange((void*)src, SHA_BLOCK_SIZE * blocks);
     ahb_flush_to(RB_SHA);
 
     // tell sha1 controller the block source address
-    write32(SHA_SRC, dma_addr(block));
+    write32(SHA_SRC, dma_addr((void*)src));
 
     // tell sha1 controller number of blocks
-    write32(SHA_CTRL, (read32(SHA_CTRL) & ~(SHA_CMD_AREA_BLOCK)) | (blocks - 1));
+    write32(SHA_CTRL, (read32(SHA_CTRL) & ~(SHA_CMD_AREA_BLOCK | SHA_CMD_FLAG_IRQ)) | (blocks - 1));
 
     // fire up hashing and wait till its finished
     write32(SHA_CTRL, read32(SHA_CTRL) | SHA_CMD_FLAG_EXEC);
     while (read32(SHA_CTRL) & SHA_CMD_FLAG_EXEC);
+}
+
+// background update, continued from sha_irq() or sha_poll() until all blocks are hashed
+static struct {
+    u32* state;
+    const u8* src;
+    u32 blocks;
+    bool active;
+} sha_job;
+
+static void _sha_job_advance(void)
+{
+    if(!sha_job.active || (read32(SHA_CTRL) & SHA_CMD_FLAG_EXEC))
+        return;
+
+    if(!sha_job.blocks) {
+        sha_job.state[0] = read32(SHA_H0);
+        sha_job.state[1] = read32(SHA_H1);
+        sha_job.state[2] = read32(SHA_H2);
+        sha_job.state[3] = read32(SHA_H3);
+        sha_job.state[4] = read32(SHA_H4);
+        sha_job.active = false;
+        return;
+    }
+
+    u32 count = min(sha_job.blocks, SHA_MAX_BLOCKS);
+    write32(SHA_SRC, dma_addr((void*)sha_job.src));
+    write32(SHA_CTRL, SHA_CMD_FLAG_EXEC | SHA_CMD_FLAG_IRQ | (count - 1));
+    sha_job.src += SHA_BLOCK_SIZE * count;
+    sha_job.blocks -= count;
+}
+
+void sha_irq(void)
+{
+    _sha_job_advance();
+}
+
+bool sha_poll(void)
+{
+    u32 cookie = irq_kill();
+    _sha_job_advance();
+    bool done = !sha_job.active;
+    irq_restore(cookie);
+    return done;
+}
+
+void sha_wait(void)
+{
+    while(!sha_poll());
+}
+
+static void sha_transform(u32 state[SHA_HASH_WORDS], const u8* buffer, u32 blocks)
+{
+    sha_wait();
+    if(blocks == 0) return;
+
+    /* Copy ctx->state[] to working vars, the engine carries them from one command to the next */
+    write32(SHA_H0, state[0]);
+    write32(SHA_H1, state[1]);
+    write32(SHA_H2, state[2]);
+    write32(SHA_H3, state[3]);
+    write32(SHA_H4, state[4]);
 
-    // free the aligned data
-    free(block);
+#ifndef MINUTE_BOOT1
+    if(sha_legacy_copy) {
+        u8 *block = memalign(128, SHA_BLOCK_SIZE * blocks);
+        memcpy(block, buffer, SHA_BLOCK_SIZE * blocks);
+        for(u32 done = 0; done < blocks; done += SHA_MAX_BLOCKS)
+            _sha_run(block + done * SHA_BLOCK_SIZE, min(blocks - done, SHA_MAX_BLOCKS));
+        free(block);
+        blocks = 0;
+    }
+#endif
+
+    while(blocks) {
+        u32 count;
+        if(((u32)buffer & (SHA_DMA_ALIGN - 1)) == 0) {
+            count = min(blocks, SHA_MAX_BLOCKS);
+            _sha_run(buffer, count);
+        } else {
+            count = min(blocks, SHA_STAGING_BLOCKS);
+            memcpy(sha_staging, buffer, SHA_BLOCK_SIZE * count);
+            _sha_run(sha_staging, count);
+        }
+        buffer += SHA_BLOCK_SIZE * count;
+        blocks -= count;
+    }
 
     /* Add the working vars back into ctx.state[] */
     state[0] = read32(SHA_H0);
@@ -94,25 +175,48 @@ void sha_update(sha_ctx* ctx, const void* inbuf, size_t size)
     if ((j + size) > 63) {
         memcpy(&ctx->buffer[j], data, (i = 64-j));
         sha_transform(ctx->state, ctx->buffer, 1);
-        // try bigger blocks at once
-        for ( ; i + 63 + ((BLOCKSIZE-1)*64) < size; i += (64 + (BLOCKSIZE-1)*64)) {
-            sha_transform(ctx->state, &data[i], BLOCKSIZE);
-        }
-        for ( ; i + 63 + (((BLOCKSIZE/2)-1)*64) < size; i += (64 + ((BLOCKSIZE/2)-1)*64)) {
-            sha_transform(ctx->state, &data[i], BLOCKSIZE/2);
-        }
-        for ( ; i + 63 + (((BLOCKSIZE/4)-1)*64) < size; i += (64 + ((BLOCKSIZE/4)-1)*64)) {
-            sha_transform(ctx->state, &data[i], BLOCKSIZE/4);
-        }
-        for ( ; i + 63 < size; i += 64) {
-            sha_transform(ctx->state, &data[i], 1);
-        }
+        // hand all remaining whole blocks over at once
+        u32 blocks = (size - i) / SHA_BLOCK_SIZE;
+        sha_transform(ctx->state, &data[i], blocks);
+        i += blocks * SHA_BLOCK_SIZE;
         j = 0;
     }
     else i = 0;
     memcpy(&ctx->buffer[j], &data[i], size - i);
 }
 
+void sha_update_async(sha_ctx* ctx, const void* inbuf, size_t size)
+{
+    sha_wait();
+
+    // only whole, aligned blocks on a block boundary can be hashed in place
+    if(size == 0 || (ctx->count[0] & 511) || (size & (SHA_BLOCK_SIZE - 1)) ||
+       ((u32)inbuf & (SHA_DMA_ALIGN - 1))) {
+        sha_update(ctx, inbuf, size);
+        return;
+    }
+
+    if ((ctx->count[0] += size << 3) < (size << 3))
+        ctx->count[1]++;
+    ctx->count[1] += (size >> 29);
+
+    dc_flushrange((void*)inbuf, size);
+    ahb_flush_to(RB_SHA);
+
+    u32 cookie = irq_kill();
+    write32(SHA_H0, ctx->state[0]);
+    write32(SHA_H1, ctx->state[1]);
+    write32(SHA_H2, ctx->state[2]);
+    write32(SHA_H3, ctx->state[3]);
+    write32(SHA_H4, ctx->state[4]);
+    sha_job.state = ctx->state;
+    sha_job.src = inbuf;
+    sha_job.blocks = size / SHA_BLOCK_SIZE;
+    sha_job.active = true;
+    _sha_job_advance();
+    irq_restore(cookie);
+}
+
 void sha_final(sha_ctx* ctx, void* outbuf)
 {
     u8 final_count[8];
@@ -147,3 +251,48 @@ void sha_hash(const void* inbuf, void* outbuf, size_t size)
     sha_update(&ctx, inbuf, size);
     sha_final(&ctx, outbuf);
 }
+
+#ifndef MINUTE_BOOT1
+/* hashes size bytes (aligned and misaligned) with the old copying path and the in-place one,
+   then checks both paths against the FIPS 180 digest of a million 'a' */
+void sha_benchmark(size_t size)
+{
+    static const u8 million_a[SHA_HASH_SIZE] = {
+        0x34, 0xaa, 0x97, 0x3c, 0xd4, 0xc4, 0xda, 0xa4, 0xf6, 0x1e,
+        0xeb, 0x2b, 0xdb, 0xad, 0x27, 0x31, 0x65, 0x34, 0x01, 0x6f
+    };
+    u8 digest_old[SHA_HASH_SIZE], digest_new[SHA_HASH_SIZE];
+    u8* buf = memalign(128, max(size, 1000000) + SHA_DMA_ALIGN);
+    if(!buf) {
+        printf("SHA: can't allocate 0x%x bytes\n", max(size, 1000000));
+        return;
+    }
+    for(size_t i = 0; i < size + SHA_DMA_ALIGN; i++)
+        buf[i] = i * 7 + (i >> 8);
+
+    for(int misaligned = 0; misaligned < 2; misaligned++) {
+        const u8* data = buf + misaligned;
+
+        sha_legacy_copy = true;
+        u32 start = read32(LT_TIMER);
+        sha_hash(data, digest_old, size);
+        u32 mid = read32(LT_TIMER);
+        sha_legacy_copy = false;
+        sha_hash(data, digest_new, size);
+        u32 end = read32(LT_TIMER);
+
+        printf("SHA %s: copy %lu us, in place %lu us%s\n", misaligned ? "misaligned" : "aligned",
+               (mid - start) * 10 / 19, (end - mid) * 10 / 19,
+               memcmp(digest_old, digest_new, SHA_HASH_SIZE) ? ", DIGEST MISMATCH" : "");
+    }
+
+    memset(buf, 'a', 1000000 + 1);
+    for(int misaligned = 0; misaligned < 2; misaligned++) {
+        sha_hash(buf + misaligned, digest_new, 1000000);
+        printf("SHA %s: known answer %s\n", misaligned ? "misaligned" : "aligned",
+               memcmp(digest_new, million_a, SHA_HASH_SIZE) ? "MISMATCH" : "ok");
+    }
+
+    free(buf);
+}
+#endif
@@ -31,6 +31,13 @@ void sha_init(sha_ctx* ctx);
 void sha_update(sha_ctx* ctx, const void* inbuf, size_t size);
 void sha_final(sha_ctx* ctx, void* outbuf);
 
+// hashes whole aligned blocks in the background, anything else is done right away
+void sha_update_async(sha_ctx* ctx, const void* inbuf, size_t size);
+bool sha_poll(void);
+void sha_wait(void);
+void sha_irq(void);
+
 void sha_hash(const void* inbuf, void* outbuf, size_t size);
+void sha_benchmark(size_t size);
 
 #endif
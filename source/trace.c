@@ -0,0 +1,176 @@
+/*
+ *  minute - a port of the "mini" IOS replacement for the Wii U.
+ *
+ *  This code is licensed to you under the terms of the GNU GPL, version 2;
+ *  see file COPYING or http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#include "trace.h"
+#include "latte.h"
+#include "utils.h"
+#include "memory.h"
+#include "string.h"
+#include "prsh.h"
+#include "gfx.h"
+
+#include <stdio.h>
+
+static trace_buf trace_ring;
+static trace_buf* trace = &trace_ring;
+
+// LT_TIMER runs at 1.9MHz
+static u32 _trace_us(u32 ticks)
+{
+    return (u32)(((u64)ticks * 10) / 19);
+}
+
+static trace_event* _trace_add(const char* name, u8 type, u32 value)
+{
+    if(trace->magic != TRACE_MAGIC)
+        trace_init();
+
+    u32 id = trace->count++;
+    trace_event* ev = &trace->events[id & (TRACE_EVENTS - 1)];
+    ev->id = id;
+    ev->start = read32(LT_TIMER);
+    ev->value = value;
+    ev->type = type;
+    strncpy(ev->name, name, TRACE_NAME_LEN - 1);
+    ev->name[TRACE_NAME_LEN - 1] = '\0';
+    return ev;
+}
+
+void trace_init(void)
+{
+    memset(trace, 0, sizeof(*trace));
+    trace->magic = TRACE_MAGIC;
+    trace->base = read32(LT_TIMER);
+}
+
+int trace_begin(const char* name)
+{
+    return _trace_add(name, TRACE_SPAN_OPEN, 0)->id;
+}
+
+void trace_end(int id)
+{
+    trace_event* ev = &trace->events[(u32)id & (TRACE_EVENTS - 1)];
+
+    // the slot may have been reused by the time a long span ends
+    if(id < 0 || ev->id != (u32)id || ev->type != TRACE_SPAN_OPEN)
+        return;
+
+    ev->value = read32(LT_TIMER) - ev->start;
+    ev->type = TRACE_SPAN;
+}
+
+void trace_counter(const char* name, u32 value)
+{
+    _trace_add(name, TRACE_COUNTER, value);
+}
+
+static u32 _trace_first(const trace_buf* buf)
+{
+    return buf->count > TRACE_EVENTS ? buf->count - TRACE_EVENTS : 0;
+}
+
+void trace_print(void)
+{
+    u32 now = read32(LT_TIMER);
+
+    printf("trace: %lu events, %lu us since start\n", trace->count, _trace_us(now - trace->base));
+    for(u32 i = _trace_first(trace); i < trace->count; i++) {
+        const trace_event* ev = &trace->events[i & (TRACE_EVENTS - 1)];
+        u32 at = _trace_us(ev->start - trace->base);
+
+        if(ev->type == TRACE_COUNTER)
+            printf("  %-18s @%9lu  = %lu\n", ev->name, at, ev->value);
+        else if(ev->type == TRACE_SPAN)
+            printf("  %-18s @%9lu  %9lu us\n", ev->name, at, _trace_us(ev->value));
+        else
+            printf("  %-18s @%9lu  (open)\n", ev->name, at);
+    }
+}
+
+#ifndef MINUTE_BOOT1
+/* Chrome trace event format, load it in chrome://tracing or Perfetto. Spans that
+   never ended are cut off at the time of writing. */
+static int _trace_write_json(const trace_buf* buf, const char* path, u32 now)
+{
+    FILE* f = fopen(path, "w");
+    if(!f) {
+        printf("trace: failed to open `%s`!\n", path);
+        return -1;
+    }
+
+    fprintf(f, "{\"traceEvents\":[\n");
+    for(u32 i = _trace_first(buf); i < buf->count; i++) {
+        const trace_event* ev = &buf->events[i & (TRACE_EVENTS - 1)];
+        u32 ts = _trace_us(ev->start - buf->base);
+        const char* sep = (i + 1 < buf->count) ? "," : "";
+
+        if(ev->type == TRACE_COUNTER) {
+            fprintf(f, "{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%lu,\"pid\":0,\"tid\":0,"
+                    "\"args\":{\"value\":%lu}}%s\n", ev->name, ts, ev->value, sep);
+        } else {
+            u32 dur = ev->type == TRACE_SPAN ? ev->value : now - ev->start;
+            fprintf(f, "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%lu,\"dur\":%lu,\"pid\":0,\"tid\":0}%s\n",
+                    ev->name, ts, _trace_us(dur), sep);
+        }
+    }
+    fprintf(f, "],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(f);
+
+    printf("trace: wrote %lu events to `%s`\n", buf->count - _trace_first(buf), path);
+    return 0;
+}
+
+int trace_write_json(const char* path)
+{
+    return _trace_write_json(trace, path, read32(LT_TIMER));
+}
+
+// the ring of the last boot, left in the plugin carveout by trace_persist
+int trace_save_previous(const char* path)
+{
+    trace_buf* prev = NULL;
+    size_t size = 0;
+
+    if(prsh_get_entry(TRACE_PRSH_ENTRY, (void**)&prev, &size))
+        return 0;
+    if(!prev || size != sizeof(trace_buf) || prev == trace)
+        return 0;
+
+    dc_invalidaterange(prev, sizeof(trace_buf));
+    if(prev->magic != TRACE_MAGIC)
+        return 0;
+
+    // open spans of the last boot ended with minute, at the latest event
+    u32 last = prev->base;
+    for(u32 i = _trace_first(prev); i < prev->count; i++) {
+        const trace_event* ev = &prev->events[i & (TRACE_EVENTS - 1)];
+        u32 end = ev->start + (ev->type == TRACE_SPAN ? ev->value : 0);
+        if(end - prev->base > last - prev->base)
+            last = end;
+    }
+
+    int res = _trace_write_json(prev, path, last);
+    prev->magic = 0;
+    dc_flushrange(prev, sizeof(trace_buf));
+    return res;
+}
+#endif
+
+const trace_buf* trace_get(void)
+{
+    return trace;
+}
+
+trace_buf* trace_persist(trace_buf* dst)
+{
+    if(dst != trace)
+        memcpy(dst, trace, sizeof(*trace));
+    trace = dst;
+    prsh_set_entry(TRACE_PRSH_ENTRY, dst, sizeof(*dst));
+    return dst;
+}
@@ -0,0 +1,57 @@
+/*
+ *  minute - a port of the "mini" IOS replacement for the Wii U.
+ *
+ *  This code is licensed to you under the terms of the GNU GPL, version 2;
+ *  see file COPYING or http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include "types.h"
+
+#define TRACE_MAGIC         (0x54524345) // TRCE
+#define TRACE_EVENTS        128 // power of two, oldest events are overwritten
+#define TRACE_NAME_LEN      19
+
+#define TRACE_SPAN          1
+#define TRACE_SPAN_OPEN     2
+#define TRACE_COUNTER       3
+
+#define TRACE_FILE          "sdmc:/minute/boot_trace.json"
+#define TRACE_FILE_PREV     "sdmc:/minute/boot_trace_prev.json"
+#define TRACE_PRSH_ENTRY    "minute_trace"
+
+typedef struct {
+    u32 id;
+    u32 start; // LT_TIMER
+    u32 value; // span length in ticks, or counter value
+    u8 type;
+    char name[TRACE_NAME_LEN];
+} PACKED trace_event;
+_Static_assert(sizeof(trace_event) == 0x20, "trace_event size must be 0x20!");
+
+typedef struct {
+    u32 magic;
+    u32 count; // events ever recorded, the ring holds the last TRACE_EVENTS
+    u32 base; // LT_TIMER when tracing started
+    u32 pad;
+    trace_event events[TRACE_EVENTS];
+} PACKED trace_buf;
+
+void trace_init(void);
+
+// returns a handle for trace_end, spans may nest
+int trace_begin(const char* name);
+void trace_end(int id);
+void trace_counter(const char* name, u32 value);
+
+void trace_print(void);
+int trace_write_json(const char* path);
+
+const trace_buf* trace_get(void);
+// moves the ring to memory that outlives minute and publishes it in PRSH
+trace_buf* trace_persist(trace_buf* dst);
+int trace_save_previous(const char* path);
+
+#endif
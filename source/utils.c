@@ -15,6 +15,7 @@
 #include "gfx.h"
 #include "gpio.h"
 #include "latte.h"
+#include "log.h"
 
 #include <stdarg.h>
 
@@ -68,6 +69,7 @@ void udelay(u32 d)
 
 void panic(u8 v)
 {
+    log_flush();
     while(true) {
         //debug_output(v);
         //set32(HW_GPIO1BOUT, BIT(GP_SLOTLED));